@@ -0,0 +1,74 @@
+//
+// Created by fanghr on 2020/6/3.
+//
+
+#include <atomic>
+#include <mutex>
+
+#include <benchmark/benchmark.h>
+#include <fsm/fsm.h>
+
+// Transactions over two of 64 machines from several threads: once with
+// `DispatchAll()` taking each machine's own lock, once serialized by one
+// global lock around machines without locks of their own.
+
+namespace {
+constexpr unsigned kMachines = 64;
+
+struct Flip {};
+
+class Mutex : public fsm::detail::RWMutexInterface {
+ public:
+  void Lock() override { mutex_.lock(); }
+  void Unlock() override { mutex_.unlock(); }
+  void RLock() override { mutex_.lock(); }
+  void RUnlock() override { mutex_.unlock(); }
+
+ private:
+  std::mutex mutex_;
+};
+
+template<class AtomicBool, class MutexType>
+class Switch : public fsm::FSM<Switch<AtomicBool, MutexType>, int, AtomicBool, MutexType> {
+  using Base = fsm::FSM<Switch<AtomicBool, MutexType>, int, AtomicBool, MutexType>;
+  friend Base;
+
+  using TransitionTable = typename Base::template Table<
+      typename Base::template BasicRow<0, Flip, 1>,
+      typename Base::template BasicRow<1, Flip, 0>>;
+};
+
+using LockedSwitch = Switch<std::atomic<bool>, Mutex>;
+using PlainSwitch = Switch<bool, fsm::detail::FakeRWMutex>;
+
+// Runs a transaction as is, relying on the machines' own locks.
+struct NoLock {
+  template<class Transaction>
+  fsm::TransactionResult operator()(Transaction transaction) const { return transaction(); }
+};
+
+struct GlobalLock {
+  template<class Transaction>
+  fsm::TransactionResult operator()(Transaction transaction) const {
+    static std::mutex mutex;
+    std::lock_guard<std::mutex> lock(mutex);
+    return transaction();
+  }
+};
+
+template<class Machine, class Lock>
+void BM_Transactions(benchmark::State &state) {
+  static Machine machines[kMachines];
+  auto seed = static_cast<unsigned>(state.thread_index()) + 1;
+  for (auto _ : state) {
+    seed = seed * 1103515245u + 12345u;
+    auto i = (seed >> 16u) % kMachines, j = (i + 1 + (seed >> 8u) % (kMachines - 1)) % kMachines;
+    auto result = Lock{}([&] { return fsm::DispatchAll(machines[i], Flip{}, machines[j], Flip{}); });
+    benchmark::DoNotOptimize(result);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+}
+
+BENCHMARK_TEMPLATE(BM_Transactions, LockedSwitch, NoLock)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Transactions, PlainSwitch, GlobalLock)->ThreadRange(1, 8)->UseRealTime();
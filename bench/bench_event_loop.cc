@@ -0,0 +1,77 @@
+//
+// Created by fanghr on 2020/6/3.
+//
+
+#include <memory>
+#include <system_error>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <benchmark/benchmark.h>
+#include <fsm/event_loop.h>
+
+// Readiness of many socketpairs dispatched through the epoll and the
+// io_uring loops. Each iteration makes every pair readable once, runs the
+// loop until all of them were handled, and lets the machines drain them.
+
+namespace {
+class Reader : public fsm::FSM<Reader> {
+  friend class FSM;
+ public:
+  enum States { kOpen };
+
+  long long bytes = 0;
+
+ private:
+  void Read(const fsm::Readable &event) {
+    char buffer[16];
+    auto n = read(event.fd, buffer, sizeof(buffer));
+    if (n > 0)
+      bytes += n;
+  }
+
+  using TransitionTable = Table<MemFnRow<kOpen, fsm::Readable, kOpen, &Reader::Read>>;
+};
+
+template<class Loop>
+void BM_SocketPairs(benchmark::State &state) {
+  auto pairs = static_cast<std::size_t>(state.range(0));
+  std::unique_ptr<Loop> loop;
+  try {
+    loop.reset(new Loop());
+  } catch (const std::system_error &e) {
+    state.SkipWithError(e.what());
+    return;
+  }
+
+  std::vector<Reader> readers(pairs);
+  std::vector<int> fds(pairs * 2);
+  for (std::size_t i = 0; i < pairs; ++i) {
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, &fds[i * 2]) != 0) {
+      state.SkipWithError("socketpair");
+      return;
+    }
+    loop->Add(fds[i * 2], readers[i], Loop::kReadable);
+  }
+
+  for (auto _ : state) {
+    for (std::size_t i = 0; i < pairs; ++i) {
+      if (write(fds[i * 2 + 1], "x", 1) != 1)
+        state.SkipWithError("write");
+    }
+    for (std::size_t handled = 0; handled < pairs;)
+      handled += loop->RunOnce(1000);
+  }
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * pairs));
+
+  for (std::size_t i = 0; i < pairs; ++i)
+    loop->Remove(fds[i * 2]);
+  for (auto fd : fds)
+    close(fd);
+}
+}
+
+BENCHMARK_TEMPLATE(BM_SocketPairs, fsm::EpollEventLoop)->Range(8, 512);
+BENCHMARK_TEMPLATE(BM_SocketPairs, fsm::IoUringEventLoop)->Range(8, 512);
@@ -0,0 +1,65 @@
+//
+// Created by fanghr on 2020/6/5.
+//
+
+#include <benchmark/benchmark.h>
+
+#include "fsmc_ring.h"
+#include "ring.fsm.h" // generated by fsmc from FSMC_RING
+#include "ring_table.fsm.h" // generated by fsmc --table from FSMC_RING
+
+// A ring of 32 states with a row for each of 8 events in every state, i.e.
+// 256 rows, dispatched through the `switch` fsmc generates and through the
+// row templates of the same table (`fsm::FSM::Dispatch()` over the
+// `TransitionTable` of `fsmc --table`). fsmc_compile_time times compiling
+// the two.
+
+namespace {
+using namespace fsmc_bench;
+
+template<template<class, class...> class Generated>
+class Ring : public Generated<Ring<Generated>> {
+  friend fsm::FSM<Ring, typename Generated<Ring>::States>;
+  friend Generated<Ring>;
+
+ public:
+  std::size_t moves = 0;
+
+ private:
+  template<class Event>
+  void Count(const Event &) { ++moves; }
+};
+
+using SwitchRing = Ring<RingBase>;
+using TableRing = Ring<TableRingBase>;
+
+struct Switch {
+  template<class Machine, class Event>
+  static void Dispatch(Machine &machine, const Event &event) { machine.Dispatch(event); }
+};
+
+struct Rows {
+  template<class Machine, class Event>
+  static void Dispatch(Machine &machine, const Event &event) {
+    static_cast<fsm::FSM<Machine, typename Machine::States> &>(machine).Dispatch(event);
+  }
+};
+
+template<class Machine, class Via>
+void BM_Ring(benchmark::State &state) {
+  Machine machine;
+  for (auto _ : state) {
+    // the state is unknown to the compiler in every iteration
+    benchmark::DoNotOptimize(&machine);
+    Via::Dispatch(machine, E0{});
+    Via::Dispatch(machine, E3{});
+    Via::Dispatch(machine, E5{});
+    Via::Dispatch(machine, E7{});
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * 4);
+}
+}
+
+BENCHMARK_TEMPLATE(BM_Ring, SwitchRing, Switch);
+BENCHMARK_TEMPLATE(BM_Ring, TableRing, Rows);
@@ -0,0 +1,77 @@
+//
+// Created by fanghr on 2020/6/6.
+//
+
+#include <benchmark/benchmark.h>
+#include <fsm/fsm.h>
+
+// Two parallel chains of kLength states between kIdle and kDone, entered by
+// Go or Alt, walked by Next and left by Cancel, with and without
+// `kMinimizeTable`. Minimization merges the chains into one, so its table
+// has a class per position instead of a row per state.
+
+namespace {
+using fsm::detail::IndexSequence;
+using fsm::detail::MakeIndexSequence;
+
+constexpr int kLength = 60;
+constexpr int kIdle = 0, kDone = 2 * kLength + 1;
+constexpr int kEvents = 5;
+
+struct Go {};
+struct Alt {};
+struct Next {};
+struct Cancel {};
+struct Reset {};
+
+template<bool minimize>
+class Chain : public fsm::FSM<Chain<minimize>> {
+  using Base = fsm::FSM<Chain<minimize>>;
+  friend Base;
+ public:
+  static constexpr bool kMinimizeTable = minimize;
+
+ private:
+  template<class Steps, class Positions>
+  struct Rows;
+
+  template<unsigned... step, unsigned... position>
+  struct Rows<IndexSequence<step...>, IndexSequence<position...>> {
+    using Type = typename Base::template Table<
+        typename Base::template BasicRow<kIdle, Go, 1>,
+        typename Base::template BasicRow<kIdle, Alt, kLength + 1>,
+        typename Base::template BasicRow<1 + step, Next, 2 + step>...,
+        typename Base::template BasicRow<kLength + 1 + step, Next, kLength + 2 + step>...,
+        typename Base::template BasicRow<kLength, Next, kDone>,
+        typename Base::template BasicRow<2 * kLength, Next, kDone>,
+        typename Base::template BasicRow<1 + position, Cancel, kIdle>...,
+        typename Base::template BasicRow<kLength + 1 + position, Cancel, kIdle>...,
+        typename Base::template BasicRow<kDone, Reset, kIdle>>;
+  };
+
+  using TransitionTable = typename Rows<typename MakeIndexSequence<kLength - 1>::Type,
+                                        typename MakeIndexSequence<kLength>::Type>::Type;
+};
+
+using Minimal = Chain<true>;
+using Plain = Chain<false>;
+
+static_assert(Minimal::CanonicalStateCount() == kLength + 2, "idle, a class per position, done");
+static_assert(Minimal::MinimalTableBytes() < (kDone + 1) * kEvents, "a target per state and event");
+
+template<class Machine>
+void BM_Chain(benchmark::State &state) {
+  Machine machine;
+  for (auto _ : state) {
+    machine.Dispatch(Alt{});
+    for (int i = 0; i < kLength; ++i)
+      machine.Dispatch(Next{});
+    machine.Dispatch(Reset{});
+    benchmark::DoNotOptimize(machine.CurrentState());
+  }
+  state.SetItemsProcessed(state.iterations() * (kLength + 2));
+}
+}
+
+BENCHMARK_TEMPLATE(BM_Chain, Plain);
+BENCHMARK_TEMPLATE(BM_Chain, Minimal);
@@ -0,0 +1,66 @@
+//
+// Created by fanghr on 2020/6/3.
+//
+
+#include <benchmark/benchmark.h>
+#include <fsm/fsm.h>
+
+// The same table of plain rows under an error policy that may throw and
+// under one that doesn't; only the latter makes `Dispatch()` `noexcept`.
+
+namespace {
+enum State { kIdle, kRunning, kPaused, kStopped };
+
+struct Start {};
+struct Pause {};
+struct Resume {};
+struct Stop {};
+
+template<class ErrorPolicy>
+class Player : public fsm::FSM<Player<ErrorPolicy>, State, bool, fsm::detail::DefaultRWMutex,
+                               fsm::detail::PlainState<State>, fsm::detail::NoStatistics, ErrorPolicy> {
+  using Base = fsm::FSM<Player<ErrorPolicy>, State, bool, fsm::detail::DefaultRWMutex,
+                        fsm::detail::PlainState<State>, fsm::detail::NoStatistics, ErrorPolicy>;
+  friend Base;
+
+  using TransitionTable = typename Base::template Table<
+      typename Base::template BasicRow<kIdle, Start, kRunning>,
+      typename Base::template BasicRow<kRunning, Pause, kPaused>,
+      typename Base::template BasicRow<kPaused, Resume, kRunning>,
+      typename Base::template BasicRow<kRunning, Stop, kStopped>,
+      typename Base::template BasicRow<kPaused, Stop, kStopped>,
+      typename Base::template BasicRow<kStopped, Start, kRunning>>;
+};
+
+using NothrowPlayer = Player<fsm::ReturnStatusOnError>;
+using ThrowingPlayer = Player<fsm::detail::DefaultErrorPolicy>;
+
+static_assert(noexcept(fsm::detail::DeclVal<NothrowPlayer &>().Dispatch(Start{})), "");
+#if defined(__cpp_exceptions)
+static_assert(!noexcept(fsm::detail::DeclVal<ThrowingPlayer &>().Dispatch(Start{})), "");
+#endif
+
+// Each event is dispatched from a call the optimizer can't see through, so
+// the landing pads around it stay in the measured code.
+template<class Machine>
+__attribute__((noinline)) void Cycle(Machine &machine) {
+  machine.Dispatch(Start{});
+  machine.Dispatch(Pause{});
+  machine.Dispatch(Resume{});
+  machine.Dispatch(Pause{});
+  machine.Dispatch(Stop{});
+}
+
+template<class Machine>
+void BM_Dispatch(benchmark::State &state) {
+  Machine machine{};
+  for (auto _ : state) {
+    Cycle(machine);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * 5);
+}
+}
+
+BENCHMARK_TEMPLATE(BM_Dispatch, NothrowPlayer);
+BENCHMARK_TEMPLATE(BM_Dispatch, ThrowingPlayer);
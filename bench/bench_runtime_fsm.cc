@@ -0,0 +1,107 @@
+//
+// Created by fanghr on 2020/6/2.
+//
+
+#include <benchmark/benchmark.h>
+#include <fsm/fsm.h>
+#include <fsm/runtime_fsm.h>
+
+// The same connection table, once as a compile-time `Table` and once as a
+// `RuntimeTable`, driven through the same cycle of four events.
+
+namespace {
+struct Connect { int value; };
+struct Ack { int value; };
+struct Data { int value; };
+struct Close { int value; };
+
+class StaticMachine : public fsm::FSM<StaticMachine> {
+  friend class FSM;
+ public:
+  enum States { kIdle, kConnecting, kOpen, kClosing };
+
+  long long bytes = 0;
+
+ private:
+  void Count(const Data &data) { bytes += data.value; }
+  bool IsPositive(const Data &data) const { return data.value > 0; }
+  void Reset(const Close &) { bytes = 0; }
+
+  using TransitionTable = Table<
+      BasicRow<kIdle, Connect, kConnecting>,
+      BasicRow<kConnecting, Ack, kOpen>,
+      MemFnRow<kOpen, Data, kOpen, &StaticMachine::Count, &StaticMachine::IsPositive>,
+      BasicRow<kOpen, Data, kClosing>,
+      BasicRow<kOpen, Close, kIdle>,
+      MemFnRow<kClosing, Close, kIdle, &StaticMachine::Reset>>;
+};
+
+class RuntimeMachine : public fsm::RuntimeFSM<RuntimeMachine, int> {
+  friend class fsm::RuntimeFSM<RuntimeMachine, int>;
+ public:
+  explicit RuntimeMachine(std::shared_ptr<const TableType> table) : RuntimeFSM(std::move(table)) {}
+
+  static const RegistryType &Registry() {
+    static RegistryType registry = [] {
+      RegistryType r;
+      r.AddAction<&RuntimeMachine::Count>("Count")
+          .AddAction<&RuntimeMachine::Reset>("Reset")
+          .AddGuard<&RuntimeMachine::IsPositive>("IsPositive");
+      return r;
+    }();
+    return registry;
+  }
+
+  long long bytes = 0;
+
+ private:
+  void Count(const int &value) { bytes += value; }
+  bool IsPositive(const int &value) const { return value > 0; }
+  void Reset(const int &) { bytes = 0; }
+};
+
+const char *kTable = R"(
+states Idle Connecting Open Closing
+events connect ack data close
+Idle       connect Connecting
+Connecting ack     Open
+Open       data    Open       Count IsPositive
+Open       data    Closing
+Open       close   Idle
+Closing    close   Idle       Reset
+)";
+
+void BM_StaticTable(benchmark::State &state) {
+  StaticMachine machine{};
+  int value = 1;
+  for (auto _ : state) {
+    machine.Dispatch(Connect{value});
+    machine.Dispatch(Ack{value});
+    machine.Dispatch(Data{value});
+    machine.Dispatch(Close{value});
+    benchmark::DoNotOptimize(value);
+  }
+  benchmark::DoNotOptimize(machine.bytes);
+  state.SetItemsProcessed(state.iterations() * 4);
+}
+
+void BM_RuntimeTable(benchmark::State &state) {
+  auto table = RuntimeMachine::TableType::Parse(kTable, RuntimeMachine::Registry());
+  RuntimeMachine machine{table};
+  const RuntimeMachine::EventId connect = table->EventIndex("connect"), ack = table->EventIndex("ack"),
+      data = table->EventIndex("data"), close = table->EventIndex("close");
+  int value = 1;
+  for (auto _ : state) {
+    machine.Dispatch(connect, value);
+    machine.Dispatch(ack, value);
+    machine.Dispatch(data, value);
+    machine.Dispatch(close, value);
+    benchmark::DoNotOptimize(value);
+  }
+  benchmark::DoNotOptimize(machine.bytes);
+  state.SetItemsProcessed(state.iterations() * 4);
+}
+}
+
+BENCHMARK(BM_StaticTable);
+BENCHMARK(BM_RuntimeTable);
@@ -0,0 +1,97 @@
+//
+// Created by fanghr on 2020/6/3.
+//
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <fsm/runtime_fsm.h>
+#include <fsm/sessionizer.h>
+
+// Replay of a synthetic log of FSM_BENCH_LOG_MB megabytes (2048 by default)
+// over a million keys. The log is written once to FSM_BENCH_DIR (/tmp by
+// default) and removed at exit.
+
+namespace {
+class Session : public fsm::RuntimeFSM<Session, std::uint32_t> {
+  friend class fsm::RuntimeFSM<Session, std::uint32_t>;
+ public:
+  explicit Session(std::shared_ptr<const TableType> table) : RuntimeFSM(std::move(table)) {}
+
+  static const RegistryType &Registry() {
+    static RegistryType registry = [] {
+      RegistryType r;
+      r.AddGuard("Large", [](const Session &, const std::uint32_t &bytes) { return bytes >= 1000; });
+      return r;
+    }();
+    return registry;
+  }
+};
+
+const char *kTable = R"(
+states Offline Online Heavy
+events login data logout
+Offline login  Online
+Online  data   Heavy   -  Large
+Online  data   Online
+Heavy   data   Heavy
+Online  logout Offline
+Heavy   logout Offline
+)";
+
+using Sessionizer = fsm::Sessionizer<Session, std::uint32_t>;
+
+constexpr std::uint64_t kKeys = 1u << 20u;
+
+std::string LogPath() {
+  static const std::string path = [] {
+    auto dir = std::getenv("FSM_BENCH_DIR");
+    auto mb = std::getenv("FSM_BENCH_LOG_MB");
+    auto path = std::string(dir != nullptr ? dir : "/tmp") + "/fsm_bench_sessionizer.log";
+    auto records = (mb != nullptr ? std::strtoull(mb, nullptr, 10) : 2048) * (1u << 20u) / sizeof(Sessionizer::Record);
+
+    std::ofstream out(path, std::ios::binary);
+    std::vector<Sessionizer::Record> chunk(1u << 16u);
+    std::uint64_t seed = 1;
+    for (std::uint64_t written = 0; written < records; written += chunk.size()) {
+      for (auto &record : chunk) {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        auto event = static_cast<std::uint32_t>(seed >> 61u);
+        record = Sessionizer::Record{(seed >> 20u) % kKeys, event < 2 ? event : event < 7 ? 1u : 2u,
+                                     static_cast<std::uint32_t>(seed >> 40u) % 2000};
+      }
+      out.write(reinterpret_cast<const char *>(chunk.data()),
+                static_cast<std::streamsize>(std::min<std::uint64_t>(chunk.size(), records - written)
+                                                 * sizeof(Sessionizer::Record)));
+    }
+    return path;
+  }();
+  // registered after `path` is constructed, so it runs before `path` is destroyed
+  static const bool remove_at_exit = std::atexit([] { std::remove(LogPath().c_str()); }) == 0;
+  (void) remove_at_exit;
+  return path;
+}
+
+void BM_Sessionizer(benchmark::State &state) {
+  auto path = LogPath();
+  auto table = Session::TableType::Parse(kTable, Session::Registry());
+  Sessionizer sessionizer([&table](void *storage, std::uint64_t) { new(storage) Session(table); });
+  Sessionizer::Options options;
+  options.threads = static_cast<unsigned>(state.range(0));
+  options.event_count = static_cast<std::uint32_t>(table->EventCount());
+
+  Sessionizer::Result result{0, 0, 0};
+  for (auto _ : state)
+    result = sessionizer.Run(path, options);
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * result.records));
+  state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * result.records * sizeof(Sessionizer::Record)));
+  state.counters["transitions"] = static_cast<double>(result.transitions);
+}
+}
+
+BENCHMARK(BM_Sessionizer)->Arg(1)->Arg(2)->Arg(4)->Iterations(3)->Unit(benchmark::kMillisecond)->UseRealTime();
@@ -0,0 +1,65 @@
+//
+// Created by fanghr on 2020/6/3.
+//
+
+#include <benchmark/benchmark.h>
+#include <fsm/runtime_fsm.h>
+
+// Dispatch on a fixed `RuntimeTable` against dispatch through a
+// `RuntimeTableHandle`, whose readers only pay for entering an epoch.
+
+namespace {
+template<template<class, class> class Source>
+class Machine : public fsm::RuntimeFSM<Machine<Source>, int, Source<Machine<Source>, int>> {
+  using Base = fsm::RuntimeFSM<Machine<Source>, int, Source<Machine<Source>, int>>;
+  friend Base;
+ public:
+  using typename Base::RegistryType;
+
+  explicit Machine(Source<Machine, int> source) : Base(std::move(source)) {}
+
+  static const RegistryType &Registry() {
+    static RegistryType registry;
+    return registry;
+  }
+};
+
+using FixedMachine = Machine<fsm::FixedTableSource>;
+using SharedMachine = Machine<fsm::SharedTableSource>;
+
+const char *kTable = R"(
+states Idle Connecting Open Closing
+events connect ack data close
+Idle       connect Connecting
+Connecting ack     Open
+Open       data    Closing
+Closing    close   Idle
+)";
+
+template<class M>
+void Cycle(benchmark::State &state, M &machine) {
+  int value = 1;
+  for (auto _ : state) {
+    machine.Dispatch(0, value);
+    machine.Dispatch(1, value);
+    machine.Dispatch(2, value);
+    machine.Dispatch(3, value);
+    benchmark::DoNotOptimize(value);
+  }
+  state.SetItemsProcessed(state.iterations() * 4);
+}
+
+void BM_FixedTable(benchmark::State &state) {
+  FixedMachine machine{FixedMachine::TableType::Parse(kTable, FixedMachine::Registry())};
+  Cycle(state, machine);
+}
+
+void BM_SharedTable(benchmark::State &state) {
+  static fsm::RuntimeTableHandle<SharedMachine, int> handle{SharedMachine::TableType::Parse(kTable, SharedMachine::Registry())};
+  SharedMachine machine{handle};
+  Cycle(state, machine);
+}
+}
+
+BENCHMARK(BM_FixedTable)->ThreadRange(1, 4);
+BENCHMARK(BM_SharedTable)->ThreadRange(1, 4);
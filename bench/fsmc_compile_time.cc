@@ -0,0 +1,51 @@
+//
+// Created by fanghr on 2020/6/5.
+//
+
+// Compiled, not linked, by the fsmc_compile_time target: once dispatching
+// the ring of bench_fsmc.cc through the `switch` fsmc generates, and once,
+// with FSMC_ROWS defined, through the row templates of the same table.
+
+#include "fsmc_ring.h"
+#if defined(FSMC_ROWS)
+#include "ring_table.fsm.h"
+#else
+#include "ring.fsm.h"
+#endif
+
+namespace fsmc_bench {
+
+#if defined(FSMC_ROWS)
+template<class Derived>
+using Generated = TableRingBase<Derived>;
+#else
+template<class Derived>
+using Generated = RingBase<Derived>;
+#endif
+
+class Ring : public Generated<Ring> {
+  friend fsm::FSM<Ring, States>;
+  friend Generated<Ring>;
+
+ public:
+  int moves = 0;
+
+ private:
+  template<class Event>
+  void Count(const Event &) { ++moves; }
+};
+
+using Machine = fsm::FSM<Ring, Ring::States>;
+}
+
+int DispatchRing(fsmc_bench::Ring &ring) {
+  using namespace fsmc_bench;
+#if defined(FSMC_ROWS)
+  Machine &machine = ring;
+#else
+  Ring &machine = ring;
+#endif
+  machine.Dispatch(E0{}), machine.Dispatch(E1{}), machine.Dispatch(E2{}), machine.Dispatch(E3{});
+  machine.Dispatch(E4{}), machine.Dispatch(E5{}), machine.Dispatch(E6{}), machine.Dispatch(E7{});
+  return ring.moves;
+}
@@ -0,0 +1,22 @@
+# FSMC_RING(<output> <machine> <states>)
+#
+# Write the table description of a ring for bench_fsmc.cc: each of the eight
+# events E<e> of fsmc_ring.h moves state k<s> to k<(s + e + 1) % states> and
+# counts the move, so every state has a row for every event.
+FUNCTION(FSMC_RING OUTPUT MACHINE STATES)
+  MATH(EXPR LAST "${STATES} - 1")
+  SET(TEXT "# Generated by FSMC_RING from bench/fsmc_ring.cmake.\n")
+  STRING(APPEND TEXT "machine ${MACHINE}\nnamespace fsmc_bench\ninclude \"fsmc_ring.h\"\n\nstates")
+  FOREACH (S RANGE ${LAST})
+    STRING(APPEND TEXT " k${S}")
+  ENDFOREACH ()
+  STRING(APPEND TEXT "\nevents E0 E1 E2 E3 E4 E5 E6 E7\n\n")
+  FOREACH (S RANGE ${LAST})
+    FOREACH (E RANGE 7)
+      MATH(EXPR T "(${S} + ${E} + 1) % ${STATES}")
+      STRING(APPEND TEXT "k${S} E${E} k${T} Count\n")
+    ENDFOREACH ()
+  ENDFOREACH ()
+  # keep the timestamp, and so the generated header, if nothing changed
+  FILE(GENERATE OUTPUT ${OUTPUT} CONTENT "${TEXT}")
+ENDFUNCTION()
@@ -0,0 +1,19 @@
+//
+// Created by fanghr on 2020/6/5.
+//
+
+#ifndef FSM_BENCH_FSMC_RING_H_
+#define FSM_BENCH_FSMC_RING_H_
+
+namespace fsmc_bench {
+struct E0 {};
+struct E1 {};
+struct E2 {};
+struct E3 {};
+struct E4 {};
+struct E5 {};
+struct E6 {};
+struct E7 {};
+}
+
+#endif //FSM_BENCH_FSMC_RING_H_
@@ -0,0 +1,33 @@
+# FSMC_GENERATE(<target> <input> [TABLE])
+#
+# Compile the table description <input> with fsmc into <name>.fsm.h, where
+# <name> is the file name of <input> without extension, and make the header
+# available to <target> through `#include "<name>.fsm.h"`. The header is
+# regenerated whenever <input> or fsmc changes. With TABLE, the header also
+# declares the rows as `TransitionTable` (fsmc --table).
+FUNCTION(FSMC_GENERATE TARGET INPUT)
+  CMAKE_PARSE_ARGUMENTS(FSMC "TABLE" "" "" ${ARGN})
+  SET(FSMC_FLAGS)
+  IF (FSMC_TABLE)
+    LIST(APPEND FSMC_FLAGS --table)
+  ENDIF ()
+
+  IF (NOT TARGET fsmc)
+    MESSAGE(FATAL_ERROR "FSMC_GENERATE needs the fsmc target, configure fsm with BUILD_FSMC")
+  ENDIF ()
+
+  GET_FILENAME_COMPONENT(INPUT_PATH ${INPUT} ABSOLUTE)
+  GET_FILENAME_COMPONENT(NAME ${INPUT} NAME_WE)
+  # not fsmc/${TARGET}, which would collide with the fsmc executable
+  SET(OUTPUT_DIR ${CMAKE_CURRENT_BINARY_DIR}/${TARGET}_fsmc)
+  SET(OUTPUT ${OUTPUT_DIR}/${NAME}.fsm.h)
+
+  ADD_CUSTOM_COMMAND(OUTPUT ${OUTPUT}
+                     COMMAND ${CMAKE_COMMAND} -E make_directory ${OUTPUT_DIR}
+                     COMMAND fsmc ${FSMC_FLAGS} ${INPUT_PATH} -o ${OUTPUT}
+                     DEPENDS fsmc ${INPUT_PATH}
+                     COMMENT "Generating ${NAME}.fsm.h from ${INPUT}"
+                     VERBATIM)
+  TARGET_SOURCES(${TARGET} PRIVATE ${OUTPUT})
+  TARGET_INCLUDE_DIRECTORIES(${TARGET} PRIVATE ${OUTPUT_DIR})
+ENDFUNCTION()
@@ -0,0 +1,320 @@
+// Copyright 2020 方泓睿
+//
+// 	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// 	documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef FSM_INCLUDE_FSM_ATOMIC_STATE_H_
+#define FSM_INCLUDE_FSM_ATOMIC_STATE_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring> // for std::memcpy
+
+#if defined(__linux__)
+#include <climits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <condition_variable>
+#include <mutex>
+#endif
+
+#include "fsm.h"
+
+// State storage policies which let `FSM::CurrentState()` and `FSM::StateVersion()`
+// run without touching the dispatch lock. They require a hosted implementation
+// (<atomic>), so they live outside of `fsm.h`.
+//
+// Only one thread may `Store()` at a time, which `FSM::Dispatch()` already
+// guarantees by holding the write lock.
+
+namespace fsm {
+namespace detail {
+/**
+ * Whether `std::atomic<T>` is lock-free on every instance, as a constant.
+ * C++11 only offers `is_lock_free()` at runtime, so older standards fall
+ * back to the compiler builtin, and to `false` if there is none.
+ */
+template<class T>
+struct IsAlwaysLockFree : IntegralConstant<bool,
+#if defined(__cpp_lib_atomic_is_always_lock_free)
+    std::atomic<T>::is_always_lock_free
+#elif defined(__GNUC__) || defined(__clang__)
+    __atomic_always_lock_free(sizeof(T), nullptr)
+#else
+    false
+#endif
+> {};
+}
+
+/**
+ * State storage publishing the state word through a single `std::atomic`.
+ * `Load()` is a wait-free acquire load.
+ *
+ * @tparam T the state type, must be trivially copyable and fit in a lock-free atomic
+ */
+template<class T>
+class AtomicState {
+  static_assert(detail::IsAlwaysLockFree<T>::value, "AtomicState needs a lock-free std::atomic<T>, use SeqlockState");
+
+ public:
+  using ValueType = T;
+  using VersionType = unsigned long long;
+  using WaitFree = detail::TrueType;
+
+  explicit AtomicState(T value) : value_(value) {}
+
+  T Load() const noexcept { return value_.load(std::memory_order_acquire); }
+
+  void Store(T value) noexcept {
+    if (value == value_.load(std::memory_order_relaxed))
+      return;
+    value_.store(value, std::memory_order_release);
+    version_.store(version_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+  VersionType Version() const noexcept { return version_.load(std::memory_order_acquire); }
+
+ private:
+  std::atomic<T> value_;
+  std::atomic<VersionType> version_{0};
+};
+
+/**
+ * State storage publishing the state through a sequence lock, for state types
+ * wider than a machine word. Readers never block the writer; a reader only
+ * retries if it raced with a concurrent `Store()`.
+ *
+ * The sequence counter doubles as the state version (`sequence / 2`).
+ *
+ * @tparam T the state type, must be trivially copyable
+ */
+template<class T>
+class SeqlockState {
+ public:
+  using ValueType = T;
+  using VersionType = unsigned long long;
+  using WaitFree = detail::TrueType;
+
+  explicit SeqlockState(T value) { Write(value); }
+
+  T Load() const noexcept {
+    T value;
+    VersionType begin, end;
+    do {
+      begin = sequence_.load(std::memory_order_acquire);
+      Read(value);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      end = sequence_.load(std::memory_order_relaxed);
+    } while ((begin & 1u) != 0 || begin != end);
+    return value;
+  }
+
+  void Store(T value) noexcept {
+    T current;
+    Read(current);
+    if (value == current)
+      return;
+    auto sequence = sequence_.load(std::memory_order_relaxed);
+    sequence_.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    Write(value);
+    sequence_.store(sequence + 2, std::memory_order_release);
+  }
+
+  VersionType Version() const noexcept {
+    VersionType sequence;
+    while (((sequence = sequence_.load(std::memory_order_acquire)) & 1u) != 0) {}
+    return sequence / 2;
+  }
+
+ private:
+  using Word = unsigned long;
+
+  static constexpr unsigned long kWords = (sizeof(T) + sizeof(Word) - 1) / sizeof(Word);
+
+  // The payload is kept in relaxed atomic words so that racing reads are
+  // well-defined; torn values are discarded by the sequence check.
+  void Read(T &value) const {
+    Word words[kWords];
+    for (unsigned long i = 0; i < kWords; ++i)
+      words[i] = words_[i].load(std::memory_order_relaxed);
+    std::memcpy(&value, words, sizeof(T));
+  }
+
+  void Write(const T &value) {
+    Word words[kWords] = {};
+    std::memcpy(words, &value, sizeof(T));
+    for (unsigned long i = 0; i < kWords; ++i)
+      words_[i].store(words[i], std::memory_order_relaxed);
+  }
+
+  std::atomic<VersionType> sequence_{0};
+  std::atomic<Word> words_[kWords];
+};
+
+namespace detail {
+/**
+ * Blocks threads until a 32-bit word changes: a futex on Linux, a condition
+ * variable elsewhere.
+ */
+class Parker {
+ public:
+  using Word = std::atomic<std::uint32_t>;
+
+  /**
+   * Sleep while `word` holds `expected`, up to `timeout` if not null.
+   * May return spuriously.
+   */
+  void Wait(const Word &word, std::uint32_t expected, const std::chrono::nanoseconds *timeout) const {
+#if defined(__linux__)
+    struct timespec ts{};
+    if (timeout != nullptr) {
+      ts.tv_sec = static_cast<time_t>(timeout->count() / 1000000000);
+      ts.tv_nsec = static_cast<long>(timeout->count() % 1000000000);
+    }
+    syscall(SYS_futex, reinterpret_cast<const std::uint32_t *>(&word), FUTEX_WAIT_PRIVATE, expected,
+            timeout != nullptr ? &ts : nullptr, nullptr, 0);
+#else
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto changed = [&] { return word.load(std::memory_order_acquire) != expected; };
+    if (timeout != nullptr)
+      cv_.wait_for(lock, *timeout, changed);
+    else
+      cv_.wait(lock, changed);
+#endif
+  }
+
+  /**
+   * Wake every thread sleeping on `word`; call after changing it.
+   */
+  void WakeAll(const Word &word) const noexcept {
+#if defined(__linux__)
+    syscall(SYS_futex, reinterpret_cast<const std::uint32_t *>(&word), FUTEX_WAKE_PRIVATE, INT_MAX,
+            nullptr, nullptr, 0);
+#else
+    { std::lock_guard<std::mutex> lock(mutex_); }
+    cv_.notify_all();
+#endif
+  }
+
+#if !defined(__linux__)
+ private:
+  mutable std::mutex mutex_;
+  mutable std::condition_variable cv_;
+#endif
+};
+}
+
+/**
+ * State storage like `AtomicState` which also lets threads block until the
+ * state satisfies a predicate, see `FSM::WaitForState()` and `FSM::WaitUntil()`.
+ *
+ * Waiters park on a futex; `Store()` only issues a wake-up if someone is
+ * waiting, so without waiters it costs one extra load of the waiter count.
+ *
+ * @tparam T the state type, must be trivially copyable and fit in a lock-free atomic
+ */
+template<class T>
+class WaitableState {
+  static_assert(detail::IsAlwaysLockFree<T>::value, "WaitableState needs a lock-free std::atomic<T>");
+
+ public:
+  using ValueType = T;
+  using VersionType = unsigned long long;
+  using WaitFree = detail::TrueType;
+
+  explicit WaitableState(T value) : value_(value) {}
+
+  T Load() const noexcept { return value_.load(std::memory_order_acquire); }
+
+  void Store(T value) noexcept {
+    if (value == value_.load(std::memory_order_relaxed))
+      return;
+    // seq_cst store and load pair up with the waiter registering itself
+    // before reading the state, so one of the two sees the other
+    value_.store(value, std::memory_order_seq_cst);
+    version_.store(version_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    if (waiters_.load(std::memory_order_seq_cst) != 0) {
+      wake_.fetch_add(1, std::memory_order_release);
+      parker_.WakeAll(wake_);
+    }
+  }
+
+  VersionType Version() const noexcept { return version_.load(std::memory_order_acquire); }
+
+  /**
+   * Block until `predicate(Load())` holds or `timeout` elapsed.
+   *
+   * @return whether the predicate holds
+   */
+  template<class Predicate, class Rep, class Period>
+  bool WaitUntil(Predicate predicate, const std::chrono::duration<Rep, Period> &timeout) const {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::nanoseconds>(timeout);
+    return Wait(predicate, &deadline);
+  }
+
+  /**
+   * Block until `predicate(Load())` holds.
+   */
+  template<class Predicate>
+  void WaitUntil(Predicate predicate) const {
+    Wait(predicate, nullptr);
+  }
+
+ private:
+  template<class Predicate>
+  bool Wait(Predicate &predicate, const std::chrono::steady_clock::time_point *deadline) const {
+    if (predicate(Load()))
+      return true;
+
+    waiters_.fetch_add(1, std::memory_order_seq_cst);
+    bool satisfied;
+    for (;;) {
+      auto wake = wake_.load(std::memory_order_acquire);
+      if ((satisfied = predicate(value_.load(std::memory_order_seq_cst))))
+        break;
+      if (deadline == nullptr) {
+        parker_.Wait(wake_, wake, nullptr);
+        continue;
+      }
+      auto now = std::chrono::steady_clock::now();
+      if (now >= *deadline)
+        break;
+      std::chrono::nanoseconds remaining = *deadline - now;
+      parker_.Wait(wake_, wake, &remaining);
+    }
+    waiters_.fetch_sub(1, std::memory_order_relaxed);
+    return satisfied;
+  }
+
+  std::atomic<T> value_;
+  std::atomic<VersionType> version_{0};
+  mutable std::atomic<unsigned> waiters_{0};
+  detail::Parker::Word wake_{0};
+  detail::Parker parker_;
+};
+
+/**
+ * Pick `AtomicState` when `T` fits in a machine word and `std::atomic<T>` is
+ * lock-free on the target, `SeqlockState` otherwise.
+ *
+ * @tparam T the state type
+ */
+template<class T>
+using PublishedState = typename detail::Conditional<
+    sizeof(T) <= sizeof(void *) && detail::IsAlwaysLockFree<T>::value,
+    AtomicState<T>,
+    SeqlockState<T>
+>::Type;
+}
+
+#endif //FSM_INCLUDE_FSM_ATOMIC_STATE_H_
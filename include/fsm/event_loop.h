@@ -0,0 +1,454 @@
+// Copyright 2020 方泓睿
+//
+// 	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// 	documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#ifndef FSM_INCLUDE_FSM_EVENT_LOOP_H_
+#define FSM_INCLUDE_FSM_EVENT_LOOP_H_
+
+#if !defined(__linux__)
+#error "fsm/event_loop.h requires Linux"
+#endif
+
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <system_error>
+#include <vector>
+
+#include <linux/io_uring.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "fsm.h"
+
+// Drive state machines from file descriptor readiness (Linux only).
+//
+// File descriptors are registered against machine instances; every loop
+// iteration waits once for readiness, then dispatches `Readable`, `Writable`
+// and `Hangup` events to the owning machines for the whole batch. Two
+// backends are provided: epoll, and io_uring, where re-arming the polls of
+// the previous batch is submitted by the same syscall which waits for the
+// next one.
+
+namespace fsm {
+/**
+ * Dispatched when a watched file descriptor has data to read.
+ */
+struct Readable {
+  int fd;
+};
+
+/**
+ * Dispatched when a watched file descriptor accepts writes.
+ */
+struct Writable {
+  int fd;
+};
+
+/**
+ * Dispatched when the peer of a watched file descriptor hung up, or an error is pending.
+ */
+struct Hangup {
+  int fd;
+};
+
+namespace detail {
+enum ReadyMask : unsigned {
+  kReadyReadable = 1u << 0u,
+  kReadyWritable = 1u << 1u,
+  kReadyHangup = 1u << 2u,
+};
+
+/**
+ * A readiness notification: the token passed to `Add()` and what is ready.
+ */
+struct Ready {
+  std::uint64_t token;
+  unsigned mask;
+};
+
+inline std::system_error SystemError(const char *what) {
+  return std::system_error(errno, std::generic_category(), what);
+}
+
+/**
+ * Level triggered epoll backend.
+ */
+class EpollBackend {
+ public:
+  explicit EpollBackend(unsigned batch_size) : events_(batch_size) {
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ < 0)
+      throw SystemError("epoll_create1");
+  }
+
+  ~EpollBackend() { close(epoll_fd_); }
+
+  EpollBackend(const EpollBackend &) = delete;
+  EpollBackend &operator=(const EpollBackend &) = delete;
+
+  void Add(int fd, unsigned interest, std::uint64_t token) {
+    epoll_event event{};
+    event.events = ToEpoll(interest);
+    event.data.u64 = token;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) < 0)
+      throw SystemError("epoll_ctl");
+  }
+
+  void Remove(int fd, std::uint64_t) {
+    // the fd may have been closed already, which removed it implicitly
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+  }
+
+  /**
+   * Called once the notification of `token` has been handled.
+   */
+  void Rearm(int, unsigned, std::uint64_t) {}
+
+  template<class OutputIterator>
+  std::size_t Wait(int timeout_ms, OutputIterator out) {
+    auto n = epoll_wait(epoll_fd_, events_.data(), static_cast<int>(events_.size()), timeout_ms);
+    if (n < 0) {
+      if (errno == EINTR)
+        return 0;
+      throw SystemError("epoll_wait");
+    }
+    for (int i = 0; i < n; ++i, ++out)
+      *out = Ready{events_[i].data.u64, FromEpoll(events_[i].events)};
+    return static_cast<std::size_t>(n);
+  }
+
+  static unsigned ToEpoll(unsigned interest) {
+    return ((interest & kReadyReadable) ? EPOLLIN : 0u) | ((interest & kReadyWritable) ? EPOLLOUT : 0u) | EPOLLRDHUP;
+  }
+
+  static unsigned FromEpoll(unsigned events) {
+    return ((events & EPOLLIN) ? kReadyReadable : 0u) | ((events & EPOLLOUT) ? kReadyWritable : 0u)
+        | ((events & (EPOLLHUP | EPOLLERR | EPOLLRDHUP)) ? kReadyHangup : 0u);
+  }
+
+ private:
+  int epoll_fd_;
+  std::vector<epoll_event> events_;
+};
+
+/**
+ * io_uring backend issuing one-shot `IORING_OP_POLL_ADD` requests.
+ *
+ * A poll is re-armed after its notification was handled; re-arms and new
+ * registrations are queued and submitted together with the next wait, so
+ * each loop iteration costs a single `io_uring_enter`.
+ *
+ * Requires Linux 5.11 (`IORING_FEAT_EXT_ARG`) for timed waits.
+ */
+class IoUringBackend {
+ public:
+  explicit IoUringBackend(unsigned batch_size) : batch_size_(batch_size) {
+    io_uring_params params{};
+    ring_fd_ = static_cast<int>(syscall(SYS_io_uring_setup, batch_size, &params));
+    if (ring_fd_ < 0)
+      throw SystemError("io_uring_setup");
+
+    sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    single_mmap_ = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap_)
+      sq_size_ = cq_size_ = sq_size_ > cq_size_ ? sq_size_ : cq_size_;
+
+    sq_ring_ = Map(sq_size_, IORING_OFF_SQ_RING);
+    cq_ring_ = single_mmap_ ? sq_ring_ : Map(cq_size_, IORING_OFF_CQ_RING);
+    sqes_ = static_cast<io_uring_sqe *>(Map(params.sq_entries * sizeof(io_uring_sqe), IORING_OFF_SQES));
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+
+    auto sq = static_cast<char *>(sq_ring_);
+    sq_head_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    sq_entries_ = params.sq_entries;
+
+    auto cq = static_cast<char *>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+  }
+
+  ~IoUringBackend() {
+    munmap(sqes_, sqes_size_);
+    if (!single_mmap_)
+      munmap(cq_ring_, cq_size_);
+    munmap(sq_ring_, sq_size_);
+    close(ring_fd_);
+  }
+
+  IoUringBackend(const IoUringBackend &) = delete;
+  IoUringBackend &operator=(const IoUringBackend &) = delete;
+
+  void Add(int fd, unsigned interest, std::uint64_t token) {
+    Rearm(fd, interest, token);
+  }
+
+  void Remove(int, std::uint64_t token) {
+    auto &sqe = NextSqe();
+    sqe.opcode = IORING_OP_POLL_REMOVE;
+    sqe.fd = -1;
+    sqe.addr = token;
+    sqe.user_data = kIgnoredToken;
+  }
+
+  void Rearm(int fd, unsigned interest, std::uint64_t token) {
+    auto &sqe = NextSqe();
+    sqe.opcode = IORING_OP_POLL_ADD;
+    sqe.fd = fd;
+    sqe.poll32_events = EpollBackend::ToEpoll(interest);
+    sqe.user_data = token;
+  }
+
+  template<class OutputIterator>
+  std::size_t Wait(int timeout_ms, OutputIterator out) {
+    unsigned flags = timeout_ms != 0 ? IORING_ENTER_GETEVENTS : 0u;
+    __kernel_timespec ts{};
+    io_uring_getevents_arg arg{};
+    const void *argp = nullptr;
+    std::size_t argsz = 0;
+    if (timeout_ms > 0) {
+      ts.tv_sec = timeout_ms / 1000;
+      ts.tv_nsec = (timeout_ms % 1000) * 1000000LL;
+      arg.sigmask_sz = _NSIG / 8;
+      arg.ts = reinterpret_cast<std::uint64_t>(&ts);
+      flags |= IORING_ENTER_EXT_ARG;
+      argp = &arg;
+      argsz = sizeof(arg);
+    }
+    Enter(timeout_ms != 0 ? 1u : 0u, flags, argp, argsz);
+
+    // like epoll, hand out at most `batch_size` notifications; the rest stay
+    // in the completion queue for the next call
+    std::size_t n = 0;
+    auto head = *cq_head_;
+    auto tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    for (; head != tail && n < batch_size_; ++head) {
+      auto &cqe = cqes_[head & cq_mask_];
+      if (cqe.user_data == kIgnoredToken || cqe.res == -ECANCELED)
+        continue;
+      *out = Ready{cqe.user_data, cqe.res < 0 ? kReadyHangup : EpollBackend::FromEpoll(static_cast<unsigned>(cqe.res))};
+      ++out;
+      ++n;
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    return n;
+  }
+
+ private:
+  static constexpr std::uint64_t kIgnoredToken = 0;
+
+  void *Map(std::size_t size, off_t offset) {
+    auto p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, offset);
+    if (p == MAP_FAILED)
+      throw SystemError("mmap");
+    return p;
+  }
+
+  io_uring_sqe &NextSqe() {
+    // an interrupted submission leaves the queue full, so retry until there is room
+    while (pending_ == sq_entries_)
+      Enter(0, 0, nullptr, 0);
+    auto tail = *sq_tail_;
+    auto index = tail & sq_mask_;
+    auto &sqe = sqes_[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    ++pending_;
+    return sqe;
+  }
+
+  void Enter(unsigned min_complete, unsigned flags, const void *arg, std::size_t argsz) {
+    auto submitted = syscall(SYS_io_uring_enter, ring_fd_, pending_, min_complete, flags, arg, argsz);
+    if (submitted < 0) {
+      if (errno == ETIME || errno == EINTR)
+        return;
+      throw SystemError("io_uring_enter");
+    }
+    pending_ -= static_cast<unsigned>(submitted);
+  }
+
+  std::size_t batch_size_;
+  int ring_fd_;
+  bool single_mmap_;
+  std::size_t sq_size_, cq_size_, sqes_size_;
+  void *sq_ring_, *cq_ring_;
+  io_uring_sqe *sqes_;
+  unsigned *sq_head_, *sq_tail_, *sq_array_, sq_mask_, sq_entries_;
+  unsigned *cq_head_, *cq_tail_, cq_mask_;
+  io_uring_cqe *cqes_;
+  unsigned pending_ = 0;
+};
+}
+
+/**
+ * Event loop dispatching file descriptor readiness to state machines.
+ *
+ * Note that the loop *does not* guarantee thread safe; call it from one thread.
+ * Machines may `Add()` and `Remove()` file descriptors from their actions.
+ *
+ * @tparam Backend `detail::EpollBackend` or `detail::IoUringBackend`
+ */
+template<class Backend>
+class EventLoop {
+ public:
+  enum Interest : unsigned {
+    kReadable = detail::kReadyReadable,
+    kWritable = detail::kReadyWritable,
+  };
+
+  /**
+   * @param batch_size the maximum number of notifications handled per `RunOnce()`
+   * @throw std::system_error if the backend can't be created
+   */
+  explicit EventLoop(unsigned batch_size = 256) : backend_(batch_size) {
+    ready_.reserve(batch_size);
+  }
+
+  /**
+   * Watch `fd` and dispatch its readiness to `machine`. `Hangup` is always
+   * watched for.
+   *
+   * @tparam Machine the state machine class
+   * @param fd the file descriptor, which must outlive the registration
+   * @param machine the state machine, which must outlive the registration
+   * @param interest a combination of `kReadable` and `kWritable`
+   * @throw std::system_error if `fd` is already watched (`EEXIST`) or the
+   *        backend rejects it; the loop is left unchanged
+   */
+  template<class Machine>
+  void Add(int fd, Machine &machine, unsigned interest) {
+    if (fd < 0)
+      throw std::system_error(EBADF, std::generic_category(), "EventLoop::Add");
+    if (static_cast<unsigned>(fd) < fds_.size() && fds_[fd] != kNoWatch)
+      throw std::system_error(EEXIST, std::generic_category(), "EventLoop::Add");
+
+    // allocate first, so nothing is left behind if the backend fails
+    if (fds_.size() <= static_cast<unsigned>(fd))
+      fds_.resize(fd + 1, kNoWatch);
+    auto index = free_.empty() ? static_cast<unsigned>(watches_.size()) : free_.back();
+    if (index == watches_.size())
+      watches_.reserve(watches_.size() + 1);
+    auto generation = index == watches_.size() ? 1u : watches_[index].generation + 1;
+    backend_.Add(fd, interest, TokenOf(index, generation));
+
+    if (index == watches_.size())
+      watches_.push_back(Watch{});
+    else
+      free_.pop_back();
+    watches_[index] = Watch{fd, interest, &machine, &DispatchTo<Machine>, generation};
+    fds_[fd] = index;
+  }
+
+  /**
+   * Stop watching `fd`; notifications already received for it are dropped.
+   */
+  void Remove(int fd) {
+    if (fd < 0 || fds_.size() <= static_cast<unsigned>(fd) || fds_[fd] == kNoWatch)
+      return;
+    auto index = fds_[fd];
+    backend_.Remove(fd, TokenOf(index));
+    fds_[fd] = kNoWatch;
+    watches_[index].machine = nullptr;
+    ++watches_[index].generation;
+    free_.push_back(index);
+  }
+
+  /**
+   * Wait for readiness once and dispatch every notification received.
+   *
+   * @param timeout_ms how long to wait, -1 to wait forever, 0 to poll
+   * @return number of notifications dispatched
+   * @throw std::system_error if waiting fails
+   */
+  std::size_t RunOnce(int timeout_ms = -1) {
+    ready_.clear();
+    backend_.Wait(timeout_ms, std::back_inserter(ready_));
+
+    std::size_t dispatched = 0;
+    for (auto &ready : ready_) {
+      auto index = static_cast<unsigned>(ready.token);
+      auto generation = static_cast<unsigned>(ready.token >> 32u);
+      if (!Live(index, generation))
+        continue; // removed while the notification was in flight
+      ++dispatched;
+      for (auto bit : {detail::kReadyReadable, detail::kReadyWritable, detail::kReadyHangup}) {
+        if ((ready.mask & bit) != 0 && Live(index, generation))
+          watches_[index].dispatch(watches_[index].machine, watches_[index].fd, bit);
+      }
+      if (Live(index, generation))
+        backend_.Rearm(watches_[index].fd, watches_[index].interest, ready.token);
+    }
+    return dispatched;
+  }
+
+ private:
+  static constexpr unsigned kNoWatch = ~0u;
+
+  struct Watch {
+    int fd;
+    unsigned interest;
+    void *machine;
+    void (*dispatch)(void *, int, unsigned);
+    // token 0 is reserved by the backends, so generations start at 1
+    unsigned generation;
+  };
+
+  template<class Machine>
+  static void DispatchTo(void *machine, int fd, unsigned ready) {
+    auto &m = *static_cast<Machine *>(machine);
+    switch (ready) {
+      case detail::kReadyReadable: m.Dispatch(Readable{fd});
+        break;
+      case detail::kReadyWritable: m.Dispatch(Writable{fd});
+        break;
+      default: m.Dispatch(Hangup{fd});
+        break;
+    }
+  }
+
+  static std::uint64_t TokenOf(unsigned index, unsigned generation) {
+    return (static_cast<std::uint64_t>(generation) << 32u) | index;
+  }
+
+  std::uint64_t TokenOf(unsigned index) const {
+    return TokenOf(index, watches_[index].generation);
+  }
+
+  bool Live(unsigned index, unsigned generation) const {
+    return index < watches_.size() && watches_[index].generation == generation && watches_[index].machine != nullptr;
+  }
+
+  Backend backend_;
+  std::vector<Watch> watches_;
+  std::vector<unsigned> free_;
+  std::vector<unsigned> fds_;
+  std::vector<detail::Ready> ready_;
+};
+
+template<class Backend>
+constexpr unsigned EventLoop<Backend>::kNoWatch;
+
+using EpollEventLoop = EventLoop<detail::EpollBackend>;
+using IoUringEventLoop = EventLoop<detail::IoUringBackend>;
+}
+
+#endif //FSM_INCLUDE_FSM_EVENT_LOOP_H_
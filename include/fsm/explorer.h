@@ -0,0 +1,333 @@
+// Copyright 2020 方泓睿
+//
+// 	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// 	documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef FSM_INCLUDE_FSM_EXPLORER_H_
+#define FSM_INCLUDE_FSM_EXPLORER_H_
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <typeinfo>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "fsm.h"
+#include "type_name.h"
+
+// Exhaustive state-space exploration of an FSM definition.
+//
+// Starting from an initial machine, the explorer copies every reachable
+// configuration, dispatches every registered event on the copy and checks
+// user supplied invariants on each new configuration. A configuration is the
+// whole `Derived` object (state plus data), deduplicated through `Hash` and
+// `KeyEqual`, so those must take every relevant member and `CurrentState()`
+// into account.
+//
+// The frontier is spread over worker threads with work stealing: each worker
+// pops from the back of its own queue and steals from the front of others.
+// Counterexample traces are therefore valid but not necessarily shortest.
+
+namespace fsm {
+/**
+ * Parallel exhaustive state-space explorer.
+ *
+ * @tparam Derived the state machine class, must be copyable
+ * @tparam Hash hash functor for `Derived`
+ * @tparam KeyEqual equality functor for `Derived`
+ */
+template<class Derived, class Hash = std::hash<Derived>, class KeyEqual = std::equal_to<Derived>>
+class Explorer {
+ public:
+  using InvariantType = std::function<bool(const Derived &)>;
+
+  struct Violation {
+    /**
+     * Name of the violated invariant, or `exception: <what>` if dispatching threw.
+     */
+    std::string invariant;
+    /**
+     * Labels of the events leading from the initial machine to the violation.
+     */
+    std::vector<std::string> trace;
+  };
+
+  struct Result {
+    /**
+     * Number of distinct configurations visited.
+     */
+    std::size_t states;
+    /**
+     * Whether the whole state space was explored.
+     */
+    bool complete;
+    std::vector<Violation> violations;
+  };
+
+ public:
+  explicit Explorer(Derived initial, Hash hash = Hash{}, KeyEqual equal = KeyEqual{})
+      : initial_(std::move(initial)), hash_(std::move(hash)), equal_(std::move(equal)) {}
+
+  /**
+   * Dispatch `event` from every configuration.
+   */
+  template<class Event>
+  Explorer &AddEvent(Event event, std::string label = TypeName(typeid(Event))) {
+    events_.push_back(EventEntry{std::move(label), [event](Derived &machine) { machine.Dispatch(event); }});
+    return *this;
+  }
+
+  /**
+   * Dispatch a default constructed instance of every event type of
+   * `Derived::TransitionTable` from every configuration.
+   */
+  Explorer &AddTableEvents() {
+    AddDefaultEvents(typename Derived::template EventTypes<>{});
+    return *this;
+  }
+
+  Explorer &AddInvariant(std::string name, InvariantType invariant) {
+    invariants_.push_back(Invariant{std::move(name), std::move(invariant)});
+    return *this;
+  }
+
+  /**
+   * Explore the state space.
+   *
+   * @param threads number of worker threads, default to the number of cores
+   * @param max_states stop after visiting this many configurations, `0` for no limit
+   * @param stop_on_violation stop at the first violation
+   */
+  Result Run(unsigned threads = 0, std::size_t max_states = 0, bool stop_on_violation = true) {
+    if (threads == 0)
+      threads = std::max(1u, std::thread::hardware_concurrency());
+
+    Search search(*this, threads, max_states, stop_on_violation);
+    search.Start(initial_);
+
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < threads; ++i)
+      workers.emplace_back([&search, i] { search.Work(i); });
+    search.Work(0);
+    for (auto &worker : workers)
+      worker.join();
+
+    return search.Finish();
+  }
+
+ private:
+  struct EventEntry {
+    std::string label;
+    std::function<void(Derived &)> dispatch;
+  };
+
+  struct Invariant {
+    std::string name;
+    InvariantType check;
+  };
+
+  struct Node {
+    Derived machine;
+    const Node *parent;
+    unsigned event;
+  };
+
+  static std::string TypeName(const std::type_info &type) { return detail::TypeName(type); }
+
+  template<class... Events>
+  void AddDefaultEvents(detail::List<Events...>) {
+    int expand[] = {0, (AddEvent(Events{}), 0)...};
+    (void) expand;
+  }
+
+  class Search {
+   public:
+    Search(const Explorer &explorer, unsigned threads, std::size_t max_states, bool stop_on_violation)
+        : explorer_(explorer), max_states_(max_states), stop_on_violation_(stop_on_violation),
+          queues_(threads) {
+      for (auto &queue : queues_)
+        queue.reset(new Queue);
+      for (auto &shard : shards_)
+        shard.reset(new Shard(explorer_.hash_, explorer_.equal_));
+    }
+
+    void Start(const Derived &initial) {
+      const Node *node = Visit(Node{initial, nullptr, 0});
+      if (node != nullptr)
+        Push(0, node);
+    }
+
+    void Work(unsigned self) {
+      while (!stop_.load(std::memory_order_relaxed)) {
+        const Node *node = Pop(self);
+        if (node == nullptr) {
+          if (pending_.load(std::memory_order_acquire) == 0)
+            return;
+          std::this_thread::yield();
+          continue;
+        }
+        Expand(self, node);
+        pending_.fetch_sub(1, std::memory_order_acq_rel);
+      }
+    }
+
+    Result Finish() {
+      std::size_t states = 0;
+      for (auto &shard : shards_)
+        states += shard->nodes.size();
+      return Result{states, !stop_.load(), std::move(violations_)};
+    }
+
+   private:
+    static constexpr unsigned kShards = 64;
+
+    struct NodeHash {
+      const Hash *hash;
+      std::size_t operator()(const Node *node) const { return (*hash)(node->machine); }
+    };
+
+    struct NodeEqual {
+      const KeyEqual *equal;
+      bool operator()(const Node *a, const Node *b) const { return (*equal)(a->machine, b->machine); }
+    };
+
+    // One shard of the concurrent visited set; nodes live in a deque so
+    // that pointers to them stay valid.
+    struct Shard {
+      std::mutex mutex;
+      std::deque<Node> nodes;
+      std::unordered_set<const Node *, NodeHash, NodeEqual> visited;
+
+      Shard(const Hash &hash, const KeyEqual &equal) : visited(16, NodeHash{&hash}, NodeEqual{&equal}) {}
+    };
+
+    struct Queue {
+      std::mutex mutex;
+      std::deque<const Node *> nodes;
+    };
+
+    void Expand(unsigned self, const Node *node) {
+      for (unsigned i = 0; i < explorer_.events_.size() && !stop_.load(std::memory_order_relaxed); ++i) {
+        Node next{node->machine, node, i};
+#if defined(__cpp_exceptions)
+        try {
+          explorer_.events_[i].dispatch(next.machine);
+        } catch (const std::exception &e) {
+          Report(std::string("exception: ") + e.what(), next);
+          continue;
+        }
+#else
+        explorer_.events_[i].dispatch(next.machine);
+#endif
+        const Node *visited = Visit(std::move(next));
+        if (visited != nullptr)
+          Push(self, visited);
+      }
+    }
+
+    // Insert a configuration into the visited set and check the invariants;
+    // return the stored node if it is new and should be expanded.
+    const Node *Visit(Node node) {
+      auto hash = explorer_.hash_(node.machine);
+      auto &shard = *shards_[hash % kShards];
+      const Node *stored;
+      {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (shard.visited.find(&node) != shard.visited.end())
+          return nullptr;
+        shard.nodes.push_back(std::move(node));
+        stored = &shard.nodes.back();
+        shard.visited.insert(stored);
+      }
+
+      auto count = states_.fetch_add(1, std::memory_order_relaxed) + 1;
+      bool ok = true;
+      for (auto &invariant : explorer_.invariants_) {
+        if (!invariant.check(stored->machine)) {
+          Report(invariant.name, *stored);
+          ok = false;
+        }
+      }
+      if (max_states_ != 0 && count >= max_states_)
+        stop_.store(true, std::memory_order_relaxed);
+      return ok ? stored : nullptr;
+    }
+
+    void Report(const std::string &name, const Node &node) {
+      std::vector<std::string> trace;
+      for (const Node *n = &node; n->parent != nullptr; n = n->parent)
+        trace.push_back(explorer_.events_[n->event].label);
+      std::reverse(trace.begin(), trace.end());
+
+      std::lock_guard<std::mutex> lock(violations_mutex_);
+      violations_.push_back(Violation{name, std::move(trace)});
+      if (stop_on_violation_)
+        stop_.store(true, std::memory_order_relaxed);
+    }
+
+    void Push(unsigned self, const Node *node) {
+      pending_.fetch_add(1, std::memory_order_acq_rel);
+      auto &queue = *queues_[self];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      queue.nodes.push_back(node);
+    }
+
+    const Node *Pop(unsigned self) {
+      {
+        auto &queue = *queues_[self];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.nodes.empty()) {
+          auto node = queue.nodes.back();
+          queue.nodes.pop_back();
+          return node;
+        }
+      }
+      for (std::size_t i = 1; i < queues_.size(); ++i) {
+        auto &victim = *queues_[(self + i) % queues_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.nodes.empty()) {
+          auto node = victim.nodes.front();
+          victim.nodes.pop_front();
+          return node;
+        }
+      }
+      return nullptr;
+    }
+
+    const Explorer &explorer_;
+    const std::size_t max_states_;
+    const bool stop_on_violation_;
+
+    std::unique_ptr<Shard> shards_[kShards];
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::atomic<std::size_t> pending_{0};
+    std::atomic<std::size_t> states_{0};
+    std::atomic<bool> stop_{false};
+
+    std::mutex violations_mutex_;
+    std::vector<Violation> violations_;
+  };
+
+  Derived initial_;
+  Hash hash_;
+  KeyEqual equal_;
+  std::vector<EventEntry> events_;
+  std::vector<Invariant> invariants_;
+};
+}
+
+#endif //FSM_INCLUDE_FSM_EXPLORER_H_
@@ -20,8 +20,12 @@
 
 #if defined(__cpp_exceptions)
 #include <stdexcept> // for std::logic_error
+#else
+#include <stdlib.h> // for exit()
 #endif
 
+#include <assert.h> // for assert()
+
 // TODO remove all STL dependencies to support *Arduino*
 //  Current usages of types/functions in STL (mainly from <type_traits>):
 //  ❌ std::result_of (totally impossible to implement. Even partial.)
@@ -34,6 +38,7 @@
 //  ✅ (<partial implemented> fsm::detail::Forward) std::forward
 //  ✅ (<partial implemented> fsm::detail::Invoke) std::invoke
 //  ✅ (<conditional compilation>) std::logic_error (if exception is enabled)
+//  ❌ std::is_integral, std::is_enum (std::is_enum needs compiler support)
 //
 
 namespace fsm {
@@ -137,7 +142,9 @@ struct IsBaseOf : IntegralConstant<bool, IsClass<Base>::value
 };
 
 template<typename T>
-struct RemoveReference;
+struct RemoveReference {
+  using Type = T;
+};
 
 template<typename T>
 struct RemoveReference<T &&> {
@@ -149,6 +156,23 @@ struct RemoveReference<T &> {
   using Type = T;
 };
 
+// `Atomic<U>` for an `Atomic<T>` such as `std::atomic<bool>`, `U` otherwise.
+template<class T, class U>
+struct Rebind {
+  using Type = U;
+};
+
+template<template<class> class Atomic, class T, class U>
+struct Rebind<Atomic<T>, U> {
+  using Type = Atomic<U>;
+};
+
+// An address unique to the calling thread.
+inline const void *ThreadTag() noexcept {
+  static thread_local char tag;
+  return &tag;
+}
+
 template<class F, class... Args>
 using InvokeResultType = typename std::result_of<F &&(Args &&...)>::type;
 
@@ -168,6 +192,16 @@ using IsInvocableType = typename IntegralConstant<
     sizeof(IsInvocableTest::Test<F, Args...>(0)) == 1
 >::Type;
 
+// C++11 `std::declval()` may not be present on freestanding implementations.
+template<class T>
+T &&DeclVal() noexcept;
+
+template<bool...>
+struct BoolPack {};
+
+template<bool... values>
+using All = IsSame<BoolPack<true, values...>, BoolPack<values..., true>>;
+
 // C++11 `std::forward()` may not be present on freestanding implementations.
 template<class T>
 constexpr T &&Forward(typename RemoveReference<T>::Type &t) noexcept {
@@ -181,12 +215,13 @@ constexpr T &&Forward(typename RemoveReference<T>::Type &&t) noexcept {
 
 // Partial implementation of C++17 `std::invoke`.
 template<class F, class... Args>
-InvokeResultType<F, Args...> Invoke(F &&f, Args &&... args) {
+InvokeResultType<F, Args...> Invoke(F &&f, Args &&... args) noexcept(noexcept(f(args...))) {
   return f(args...);
 }
 
 template<class M, class T, class T1, class... Args>
-InvokeResultType<M T::*, T1, Args...> Invoke(M T::* f, T1 &&obj, Args &&... args) {
+InvokeResultType<M T::*, T1, Args...> Invoke(M T::* f, T1 &&obj, Args &&... args)
+noexcept(noexcept((obj.*f)(args...))) {
   return (obj.*f)(args...);
 }
 
@@ -204,7 +239,7 @@ template<class F, class Arg1, class Arg2>
 struct BinaryFnHelper<F, Arg1, Arg2, true, false, false, false> {
   using ResultType = InvokeResultType<F>;
 
-  static ResultType Invoke(F &&f, Arg1 &&, Arg2 &&) {
+  static ResultType Invoke(F &&f, Arg1 &&, Arg2 &&) noexcept(noexcept(detail::Invoke(f))) {
     return detail::Invoke(f);
   }
 };
@@ -213,7 +248,7 @@ template<class F, class Arg1, class Arg2>
 struct BinaryFnHelper<F, Arg1, Arg2, false, true, false, false> {
   using ResultType = InvokeResultType<F, Arg1>;
 
-  static ResultType Invoke(F &&f, Arg1 &&a, Arg2 &&) {
+  static ResultType Invoke(F &&f, Arg1 &&a, Arg2 &&) noexcept(noexcept(detail::Invoke(f, a))) {
     return detail::Invoke(f, a);
   }
 };
@@ -222,7 +257,7 @@ template<class F, class Arg1, class Arg2>
 struct BinaryFnHelper<F, Arg1, Arg2, false, false, true, false> {
   using ResultType = InvokeResultType<F, Arg2>;
 
-  static ResultType Invoke(F &&f, Arg1 &&, Arg2 &&b) {
+  static ResultType Invoke(F &&f, Arg1 &&, Arg2 &&b) noexcept(noexcept(detail::Invoke(f, b))) {
     return detail::Invoke(f, b);
   }
 };
@@ -231,7 +266,7 @@ template<class F, class Arg1, class Arg2>
 struct BinaryFnHelper<F, Arg1, Arg2, false, false, false, true> {
   using ResultType = InvokeResultType<F, Arg1, Arg2>;
 
-  static ResultType Invoke(F &&f, Arg1 &&a, Arg2 &&b) {
+  static ResultType Invoke(F &&f, Arg1 &&a, Arg2 &&b) noexcept(noexcept(detail::Invoke(f, a, b))) {
     return detail::Invoke(f, a, b);
   }
 };
@@ -240,7 +275,8 @@ template<class F, class Arg1, class Arg2>
 using InvokeAsBinaryFnResultType = typename BinaryFnHelper<F, Arg1, Arg2>::ResultType;
 
 template<class F, class Arg1, class Arg2>
-InvokeAsBinaryFnResultType<F, Arg1, Arg2> InvokeAsBinaryFn(F &&f, Arg1 &&a, Arg2 &&b) {
+InvokeAsBinaryFnResultType<F, Arg1, Arg2> InvokeAsBinaryFn(F &&f, Arg1 &&a, Arg2 &&b)
+noexcept(noexcept(BinaryFnHelper<F, Arg1, Arg2>::Invoke(Forward<F>(f), Forward<Arg1>(a), Forward<Arg2>(b)))) {
   return BinaryFnHelper<F, Arg1, Arg2>::Invoke(Forward<F>(f), Forward<Arg1>(a), Forward<Arg2>(b));
 }
 
@@ -281,6 +317,179 @@ struct Filter<Predicate> {
   using Type = List<>;
 };
 
+template<class T, class...>
+struct IndexOf;
+
+template<class T, class... Types>
+struct IndexOf<T, List<T, Types...>> : IntegralConstant<unsigned, 0> {};
+
+template<class T, class U, class... Types>
+struct IndexOf<T, List<U, Types...>> : IntegralConstant<unsigned, 1 + IndexOf<T, List<Types...>>::value> {};
+
+template<class T, class... Types>
+struct Contains : FalseType {};
+
+template<class T, class U, class... Types>
+struct Contains<T, U, Types...> : Contains<T, Types...> {};
+
+template<class T, class... Types>
+struct Contains<T, T, Types...> : TrueType {};
+
+/**
+ * Drop duplicated types, keeping the last occurrence of each.
+ */
+template<class...>
+struct Unique;
+
+template<>
+struct Unique<> {
+  using Type = List<>;
+};
+
+template<class T, class... Types>
+struct Unique<T, Types...> {
+  using Type = typename Conditional<
+      Contains<T, Types...>::value,
+      typename Unique<Types...>::Type,
+      typename Concat<T, typename Unique<Types...>::Type>::Type
+  >::Type;
+};
+
+template<class...>
+struct EventTypesOf;
+
+// The pseudo event of `FSM::CompletionRow`s.
+struct CompletionEvent {};
+
+template<class T>
+using IsExternalEvent = IntegralConstant<bool, !IsSame<T, CompletionEvent>::value>;
+
+template<class...>
+struct ExternalEvents;
+
+template<class... Types>
+struct ExternalEvents<List<Types...>> {
+  using Type = typename Filter<IsExternalEvent, Types...>::Type;
+};
+
+template<class... Rows>
+struct EventTypesOf<List<Rows...>> {
+  using Type = typename ExternalEvents<typename Unique<typename Rows::EventType...>::Type>::Type;
+};
+
+template<class...>
+struct Join;
+
+template<class... As, class... Bs>
+struct Join<List<As...>, List<Bs...>> {
+  using Type = List<As..., Bs...>;
+};
+
+template<unsigned long long... bits>
+struct BitOr : IntegralConstant<unsigned long long, 0> {};
+
+template<unsigned long long bit, unsigned long long... bits>
+struct BitOr<bit, bits...> : IntegralConstant<unsigned long long, bit | BitOr<bits...>::value> {};
+
+template<class...>
+struct Size;
+
+template<class... Types>
+struct Size<List<Types...>> : IntegralConstant<unsigned, sizeof...(Types)> {};
+
+template<unsigned long long... values>
+struct Max : IntegralConstant<unsigned long long, 0> {};
+
+template<unsigned long long value, unsigned long long... values>
+struct Max<value, values...> : IntegralConstant<unsigned long long,
+    (value > Max<values...>::value ? value : Max<values...>::value)> {};
+
+// Number of bits up to the highest set bit of `mask`.
+constexpr unsigned long long BitLength(unsigned long long mask) {
+  return mask == 0 ? 0 : 1 + BitLength(mask >> 1);
+}
+
+template<class T, class... Types>
+struct Last {
+  using Type = typename Last<Types...>::Type;
+};
+
+template<class T>
+struct Last<T> {
+  using Type = T;
+};
+
+/**
+ * Insert an `IntegralConstant` into a list of `IntegralConstant`s sorted in
+ * ascending order, unless an equal value is already present.
+ */
+template<class Sorted, class V>
+struct SortedInsert;
+
+template<class V>
+struct SortedInsert<List<>, V> {
+  using Type = List<V>;
+};
+
+template<class T, class... Types, class V>
+struct SortedInsert<List<T, Types...>, V> {
+  using Type = typename Conditional<
+      (V::value < T::value),
+      List<V, T, Types...>,
+      typename Conditional<
+          (V::value == T::value),
+          List<T, Types...>,
+          typename Concat<T, typename SortedInsert<List<Types...>, V>::Type>::Type
+      >::Type
+  >::Type;
+};
+
+/**
+ * Sort `IntegralConstant`s in ascending order and drop duplicates.
+ */
+template<class...>
+struct SortedUnique;
+
+template<>
+struct SortedUnique<> {
+  using Type = List<>;
+};
+
+template<class T, class... Types>
+struct SortedUnique<T, Types...> {
+  using Type = typename SortedInsert<typename SortedUnique<Types...>::Type, T>::Type;
+};
+
+template<unsigned...>
+struct IndexSequence {};
+
+template<class, class>
+struct MergeIndexSequence;
+
+template<unsigned... first, unsigned... second>
+struct MergeIndexSequence<IndexSequence<first...>, IndexSequence<second...>> {
+  using Type = IndexSequence<first..., (sizeof...(first) + second)...>;
+};
+
+// C++11 `std::make_index_sequence()` replacement with logarithmic instantiation depth.
+template<unsigned n>
+struct MakeIndexSequence {
+  using Type = typename MergeIndexSequence<
+      typename MakeIndexSequence<n / 2>::Type,
+      typename MakeIndexSequence<n - n / 2>::Type
+  >::Type;
+};
+
+template<>
+struct MakeIndexSequence<0> {
+  using Type = IndexSequence<>;
+};
+
+template<>
+struct MakeIndexSequence<1> {
+  using Type = IndexSequence<0>;
+};
+
 class RWMutexInterface {
  public:
   virtual ~RWMutexInterface() = default;
@@ -289,11 +498,11 @@ class RWMutexInterface {
   virtual void Unlock() = 0;
   virtual void RUnlock() = 0;
 
-  template<bool is_read_lock>
+  template<bool is_read_lock, class = void>
   class Guard;
 
-  template<>
-  class Guard<false> {
+  template<class Dummy>
+  class Guard<false, Dummy> {
     RWMutexInterface &mutex_;
    public:
     explicit Guard(RWMutexInterface &mutex) : mutex_(mutex) {
@@ -304,8 +513,8 @@ class RWMutexInterface {
     }
   };
 
-  template<>
-  class Guard<true> {
+  template<class Dummy>
+  class Guard<true, Dummy> {
     RWMutexInterface &mutex_;
    public:
     explicit Guard(RWMutexInterface &mutex) : mutex_(mutex) {
@@ -320,179 +529,1002 @@ class RWMutexInterface {
 class FakeRWMutex final : public RWMutexInterface {
  public:
   ~FakeRWMutex() override = default;
-  void Lock() override {}
-  void Unlock() override {}
-  void RLock() override {}
-  void RUnlock() override {}
+  void Lock() noexcept override {}
+  void Unlock() noexcept override {}
+  void RLock() noexcept override {}
+  void RUnlock() noexcept override {}
 };
 
 using DefaultRWMutex = FakeRWMutex;
 }
 
 /**
- * Finite state machine (FSM) base class template.
- *
- * TODO use *atomic* bool instead of raw bool as default.
- * Note that this class *does not* guarantee thread safe by default.
- *
- * @tparam Derived the derived state machine class
- * @tparam State the FSM's state type, default to `int`
- * @tparam AtomicBoolType the atomic bool type to implement processing lock, default to `bool`
+ * Errors `FSM::Dispatch()` may run into.
  */
-template<class Derived, class State = int,
-    class AtomicBoolType = bool,
-    class MutexType = detail::DefaultRWMutex>
-class FSM {
- public:
+enum class DispatchError {
+  kNone,
   /**
-   * The FSM's state type.
+   * `Dispatch()` was called from inside an action, guard or `NoTransition()`.
    */
-  using StateType = State;
-
- public:
+  kRecursiveDispatch,
   /**
-   * Create a finite state machine with an optional initial state.
-   *
-   * @param initial_state the FSM's initial state.
+   * Completion rows were still matching after `Derived::kMaxCompletionDepth`
+   * completion transitions.
    */
-  explicit FSM(StateType init_state = StateType{}) : state_(init_state) {}
+  kCompletionLimit,
+};
+
+namespace detail {
+/**
+ * Default error policy: throw `std::logic_error` if exceptions are enabled,
+ * `exit()` otherwise.
+ *
+ * An error policy defines `ResultType<State>`, the return type of
+ * `FSM::Dispatch()`, and the static functions `Success()` and `Failure()`
+ * building it. If `Failure()` is `noexcept`, `Dispatch()` is `noexcept` as
+ * soon as the guards and actions it may run are.
+ */
+struct DefaultErrorPolicy {
+  template<class State>
+  using ResultType = State;
+
+  template<class State>
+  static State Success(State state) noexcept {
+    return state;
+  }
+
+#if defined(__cpp_exceptions)
+  template<class State>
+  static State Failure(DispatchError error, State) {
+    if (error == DispatchError::kCompletionLimit)
+      throw std::logic_error("completion transitions exceed the depth limit");
+    throw std::logic_error("trying to lock processing lock recursively");
+  }
+#else
+  template<class State>
+  static State Failure(DispatchError, State) noexcept {
+    exit(EXIT_FAILURE);
+  }
+#endif
+};
+}
 
+/**
+ * Result of `FSM::Dispatch()` under `ReturnStatusOnError`.
+ *
+ * @tparam State the FSM's state type
+ */
+template<class State>
+struct DispatchResult {
+  DispatchError error;
   /**
-   * Dispatch an event.
-   *
-   * @warning This method shouldn't be called recursively.
-   * @tparam Event the event type
-   * @param event the optional event instance
-   * @return FSM's state after dispatching the event.
+   * FSM's state after dispatching the event. On `kRecursiveDispatch` the
+   * state is unchanged; on `kCompletionLimit` it is the state the completion
+   * rows stopped in.
    */
-  template<class Event>
-  StateType Dispatch(const Event &event = Event{}) {
-    static_assert(detail::IsBaseOf<FSM, Derived>::value, "must derive from fsm");
+  State state;
 
-    using rows = typename ByEventType<Event, typename Derived::TransitionTable>::Type;
+  constexpr explicit operator bool() const noexcept { return error == DispatchError::kNone; }
+};
 
-    ProcessingLockGuard processing_lock_guard(*this);
-    detail::RWMutexInterface::Guard<true> mutex_lock_guard(mutex_);
+/**
+ * Error policy making `Dispatch()` return a `DispatchResult` instead of a state.
+ */
+struct ReturnStatusOnError {
+  template<class State>
+  using ResultType = DispatchResult<State>;
 
-    auto &self = static_cast<Derived &>(*this);
-    state_ = HandleEvent<Event, rows>::Execute(self, event, state_);
+  template<class State>
+  static DispatchResult<State> Success(State state) noexcept {
+    return DispatchResult<State>{DispatchError::kNone, state};
+  }
 
-    return state_;
+  template<class State>
+  static DispatchResult<State> Failure(DispatchError error, State state) noexcept {
+    return DispatchResult<State>{error, state};
   }
+};
 
-  /**
-   * Dispatch an event.
-   *
-   * @warning This method shouldn't be called recursively.
-   * @tparam Event the event type
-   * @param event the optional event instance
-   * @return FSM's state after dispatching the event.
-   */
-  template<class Event>
-  StateType operator()(const Event &event) {
-    return Dispatch(event);
+/**
+ * Error policy calling `handler` and leaving the state unchanged.
+ *
+ * @tparam handler the error handler, which must not throw
+ */
+template<void (*handler)(DispatchError)>
+struct CallHandlerOnError {
+  template<class State>
+  using ResultType = State;
+
+  template<class State>
+  static State Success(State state) noexcept {
+    return state;
   }
 
-  /**
-   * Get current state of the state machine.
-   *
-   * @return current state
-   */
-  StateType CurrentState() const {
-    detail::RWMutexInterface::Guard<false> mutex_lock_guard(mutex_);
-    return state_;
+  template<class State>
+  static State Failure(DispatchError error, State state) noexcept {
+    handler(error);
+    return state;
   }
+};
 
- protected:
-  /**
-   * Called when no transition can be found for the given event
-   * in the current state. Derived state machine may override
-   * this to throw an exception, or change to some other state.
-   * The default is to return current state, so no state change occurs.
-   *
-   * @tparam Event
-   * @param event
-   * @return
-   */
-  template<class Event>
-  StateType NoTransition(const Event &event) {
-    return state_;
+/**
+ * Error policy asserting no error happens; with `NDEBUG` defined, errors
+ * leave the state unchanged.
+ */
+struct AssertOnError {
+  template<class State>
+  using ResultType = State;
+
+  template<class State>
+  static State Success(State state) noexcept {
+    return state;
   }
 
- private:
-  template<State start, class Event, State target>
-  struct RowBase {
-    using StateType = State;
-    using EventType = Event;
+  template<class State>
+  static State Failure(DispatchError error, State state) noexcept {
+    assert(error == DispatchError::kNone && "FSM::Dispatch() failed");
+    (void) error;
+    return state;
+  }
+};
 
-    static constexpr StateType StartValue() { return start; }
-    static constexpr StateType TargetValue() { return target; }
+namespace detail {
+/**
+ * Default state storage policy: a plain state word which is protected by
+ * the FSM's mutex, so reading it has to take the read lock.
+ *
+ * A state storage policy provides `Load()`, `Store()` and `Version()`, and
+ * defines `WaitFree` as `TrueType` if `Load()` and `Version()` may be called
+ * concurrently with `Store()` without holding any lock.
+ *
+ * @tparam T the state type
+ */
+template<class T>
+class PlainState {
+ public:
+  using ValueType = T;
+  using VersionType = unsigned long long;
+  using WaitFree = FalseType;
 
-   protected:
-    template<class Action>
-    static void ProcessEvent(Action &&action, Derived &self, const Event &event) {
-      detail::InvokeAsBinaryFn(action, self, event);
-    }
+  explicit PlainState(T value) : value_(value) {}
 
-    static /*constexpr*/ void ProcessEvent(detail::NullPointerType, Derived &self, const Event &event) {
-    }
+  T Load() const noexcept { return value_; }
 
-    template<class Guard>
-    static bool CheckGuard(Guard &&guard, const Derived &self, const Event &event) {
-      return detail::InvokeAsBinaryFn(guard, self, event);
-    }
+  void Store(T value) noexcept {
+    if (value == value_)
+      return;
+    value_ = value;
+    ++version_;
+  }
 
-    static constexpr bool CheckGuard(detail::NullPointerType, const Derived &, const Event &) {
-      return true;
-    }
-  };
+  VersionType Version() const noexcept { return version_; }
 
- protected:
-  /**
-   * Transition table variadic class template.
-   *
-   * Each derived state machine class *should* define a nested
-   * non-template type `TransitionTable` which is either derived from a
-   * type or a type alias of Table.
-   */
-  template<class... Rows>
-  using Table = detail::List<Rows...>;
+ private:
+  T value_;
+  VersionType version_ = 0;
+};
 
-  /**
-   * Basic transition class template.
-   *
-   * @tparam start the start state of the transition
-   * @tparam Event the event type of the transition
-   * @tparam target the target state of the transition
-   * @tparam Action a callable action function type or `detail::NullPointerType`
-   * @tparam action a static `Action` instance
-   * @tparam Guard a callable guard function type or `detail::NullPointerType`
-   * @tparam guard a static `Guard` instance
-   */
-  template<
-      State start,
-      class Event,
-      State target,
-      class Action = detail::NullPointerType,
-      Action action = nullptr,
-      class Guard = detail::NullPointerType,
-      Guard guard = nullptr
-  >
-  struct BasicRow : public RowBase<start, Event, target> {
-    static void ProcessEvent(Derived &self, const Event &event) {
-      RowBase<start, Event, target>::ProcessEvent(action, self, event);
-    }
+/**
+ * Default statistics policy: records nothing and only runs the row's action.
+ *
+ * A statistics policy wraps the action of every matched row in
+ * `Transition<Row, index>(self, event, from)`, where `index` is the row's
+ * position in `Derived::TransitionTable` and `from` the state the row is
+ * taken from, and is notified through `NoTransition<Event>()` whenever no
+ * row matches. See `fsm/statistics.h` for a recording policy.
+ */
+struct NoStatistics {
+  template<class Row, unsigned index, class Derived, class Event, class State>
+  static void Transition(Derived &self, const Event &event, State) noexcept(noexcept(Row::ProcessEvent(self, event))) {
+    Row::ProcessEvent(self, event);
+  }
 
-    static bool CheckGuard(const Derived &self, const Event &event) {
-      return RowBase<start, Event, target>::CheckGuard(guard, self, event);
-    }
-  };
+  template<class Derived, class Event, class State>
+  static void NoTransition(State) noexcept {}
+};
+
+struct Transaction;
+
+/**
+ * Compile-time minimization of transition tables without guards and
+ * actions, see `FSM::kMinimizeTable`.
+ *
+ * States are the integers [0, states). Two states are equivalent if, for
+ * every event, either neither has a row or both move to equivalent states.
+ * Equivalence classes are found by Moore's partition refinement: starting
+ * from a single class, each round splits states whose targets lie in
+ * different classes of the previous round, until a round splits nothing.
+ * A class is labelled with its smallest state.
+ *
+ * A class whose states all move to the same state on an event stores that
+ * state, so the transition lands on the original target. A class whose
+ * states move to different (equivalent) states stores the label of their
+ * targets' class instead.
+ */
+constexpr unsigned long long kNoRow = ~0ull;
+
+// Target of the first row matching a state, or `kNoRow`.
+template<class State, class Rows, class = void>
+struct FirstTarget;
+
+template<class State, class T, class... Types>
+struct FirstTarget<State, List<T, Types...>, void> {
+  static constexpr unsigned long long Of(unsigned long long state) {
+    return T::MatchesStart(static_cast<State>(state))
+           ? static_cast<unsigned long long>(T::TargetValue())
+           : FirstTarget<State, List<Types...>>::Of(state);
+  }
+};
+
+template<class State, class Void>
+struct FirstTarget<State, List<>, Void> {
+  static constexpr unsigned long long Of(unsigned long long) { return kNoRow; }
+};
+
+template<class State, class... EventRows>
+struct NextState;
+
+template<class State, class Rows, class... EventRows>
+struct NextState<State, Rows, EventRows...> {
+  static constexpr unsigned long long Of(unsigned long long state, unsigned event) {
+    return event == 0 ? FirstTarget<State, Rows>::Of(state) : NextState<State, EventRows...>::Of(state, event - 1);
+  }
+};
+
+template<class State>
+struct NextState<State> {
+  static constexpr unsigned long long Of(unsigned long long, unsigned) { return kNoRow; }
+};
+
+/**
+ * The original transitions, `kNext[state * kEvents + event]`.
+ *
+ * @tparam EventRows a `List` holding the rows of each event, in dispatch order
+ */
+template<class State, class EventRows, unsigned states, class Indices>
+struct TransitionMatrix;
+
+template<class State, class... EventRows, unsigned states, unsigned... i>
+struct TransitionMatrix<State, List<EventRows...>, states, IndexSequence<i...>> {
+  static constexpr unsigned kStates = states;
+  static constexpr unsigned kEvents = sizeof...(EventRows);
+  static constexpr unsigned long long kNext[] = {NextState<State, EventRows...>::Of(i / kEvents, i % kEvents)...};
+
+  static constexpr unsigned long long Next(unsigned long long state, unsigned event) {
+    return kNext[state * kEvents + event];
+  }
+};
+
+template<class State, class... EventRows, unsigned states, unsigned... i>
+constexpr unsigned long long TransitionMatrix<State, List<EventRows...>, states, IndexSequence<i...>>::kNext[];
+
+template<unsigned states>
+struct Unpartitioned {
+  static constexpr unsigned long long Class(unsigned long long) { return 0; }
+  static constexpr unsigned Count() { return states == 0 ? 0 : 1; }
+};
+
+// One refinement round over the `Previous` partition.
+template<class Matrix, class Previous>
+struct Refine {
+  static constexpr unsigned long long ClassOf(unsigned long long state) {
+    return state == kNoRow ? kNoRow : Previous::Class(state);
+  }
+
+  static constexpr bool SameTargets(unsigned long long s, unsigned long long t, unsigned event) {
+    return event == Matrix::kEvents
+        || (ClassOf(Matrix::Next(s, event)) == ClassOf(Matrix::Next(t, event)) && SameTargets(s, t, event + 1));
+  }
+
+  static constexpr bool Same(unsigned long long s, unsigned long long t) {
+    return Previous::Class(s) == Previous::Class(t) && SameTargets(s, t, 0);
+  }
+
+  static constexpr unsigned long long Smallest(unsigned long long s, unsigned long long t) {
+    return t == s || Same(s, t) ? t : Smallest(s, t + 1);
+  }
+
+  // New classes split old ones, so start at the smallest state of the old class.
+  static constexpr unsigned long long Class(unsigned long long s) { return Smallest(s, Previous::Class(s)); }
+};
+
+template<class Matrix, class Previous, class Indices = typename MakeIndexSequence<Matrix::kStates>::Type>
+struct Partition;
+
+template<class Matrix, class Previous, unsigned... s>
+struct Partition<Matrix, Previous, IndexSequence<s...>> {
+  static constexpr unsigned long long kClass[] = {Refine<Matrix, Previous>::Class(s)...};
+
+  static constexpr unsigned long long Class(unsigned long long state) { return kClass[state]; }
+
+  static constexpr unsigned Count(unsigned long long state = 0) {
+    return state == Matrix::kStates ? 0 : (kClass[state] == state ? 1 : 0) + Count(state + 1);
+  }
+};
+
+template<class Matrix, class Previous, unsigned... s>
+constexpr unsigned long long Partition<Matrix, Previous, IndexSequence<s...>>::kClass[];
+
+// Refinement never merges classes, so a round keeping the number of
+// classes keeps the partition.
+template<class Matrix, class Previous, class Next = Partition<Matrix, Previous>,
+    bool = Next::Count() == Previous::Count()>
+struct StablePartition {
+  using Type = typename StablePartition<Matrix, Next>::Type;
+};
+
+template<class Matrix, class Previous, class Next>
+struct StablePartition<Matrix, Previous, Next, true> {
+  using Type = Previous;
+};
+
+template<class Table, class Classes, class Targets>
+struct MinimalCells;
+
+template<class Table, unsigned... s, unsigned... i>
+struct MinimalCells<Table, IndexSequence<s...>, IndexSequence<i...>> {
+  using Cell = typename Table::Cell;
+
+  static Cell Class(unsigned long long state) noexcept {
+    static const Cell classes[] = {Table::ClassCell(s)...};
+    return classes[state];
+  }
+
+  static Cell Target(unsigned index) noexcept {
+    static const Cell targets[] = {Table::TargetCell(i)...};
+    return targets[index];
+  }
+};
+
+/**
+ * The minimized table: one row of `kEvents` cells per class, holding the
+ * target state or `kSplit`, and one cell per original state holding its
+ * class.
+ */
+template<class State, class EventRows, unsigned states>
+struct MinimalTable {
+  static_assert(states <= 256, "kMinimizeTable supports states in [0, 256)");
+
+  static_assert(Size<EventRows>::value > 0, "kMinimizeTable needs a table with events");
+
+  using Matrix = TransitionMatrix<State, EventRows, states,
+                                  typename MakeIndexSequence<states * Size<EventRows>::value>::Type>;
+  using Classes = typename StablePartition<Matrix, Unpartitioned<states>>::Type;
+  using Cell = typename Conditional<states < 255, unsigned char, unsigned short>::Type;
+
+  static constexpr unsigned kStates = states;
+  static constexpr unsigned kEvents = Matrix::kEvents;
+  static constexpr unsigned kClasses = Classes::Count();
+  static constexpr Cell kNoCell = static_cast<Cell>(~0u);
+  static constexpr unsigned long long kBytes = (states + kClasses * kEvents) * sizeof(Cell);
+
+  static constexpr State Canonical(State state) {
+    return static_cast<unsigned long long>(state) < states
+           ? static_cast<State>(Classes::Class(static_cast<unsigned long long>(state)))
+           : state;
+  }
+
+  // Number of classes labelled with a state below `label`.
+  static constexpr unsigned long long Index(unsigned long long label, unsigned long long state = 0) {
+    return state == label ? 0 : (Classes::Class(state) == state ? 1 : 0) + Index(label, state + 1);
+  }
+
+  // Label of the `index`-th class.
+  static constexpr unsigned long long Label(unsigned long long index, unsigned long long state = 0) {
+    return Classes::Class(state) != state ? Label(index, state + 1)
+                                          : index == 0 ? state : Label(index - 1, state + 1);
+  }
+
+  static constexpr Cell ClassCell(unsigned long long state) {
+    return static_cast<Cell>(Index(Classes::Class(state)));
+  }
+
+  // Whether every state of the class labelled `label` moves to the same state on `event`.
+  static constexpr bool Agree(unsigned long long label, unsigned event, unsigned long long state = 0) {
+    return state == states
+        || ((Classes::Class(state) != label || Matrix::Next(state, event) == Matrix::Next(label, event))
+            && Agree(label, event, state + 1));
+  }
+
+  static constexpr Cell TargetCell(unsigned long long index) {
+    return Matrix::Next(Label(index / kEvents), static_cast<unsigned>(index % kEvents)) == kNoRow
+           ? kNoCell
+           : Agree(Label(index / kEvents), static_cast<unsigned>(index % kEvents))
+             ? static_cast<Cell>(Matrix::Next(Label(index / kEvents), static_cast<unsigned>(index % kEvents)))
+             : static_cast<Cell>(Classes::Class(Matrix::Next(Label(index / kEvents),
+                                                             static_cast<unsigned>(index % kEvents))));
+  }
+
+  using Cells = MinimalCells<MinimalTable, typename MakeIndexSequence<states>::Type,
+                             typename MakeIndexSequence<kClasses * kEvents>::Type>;
+
+  /**
+   * Look up the target of the `event`-th event in `state`.
+   *
+   * @return false if no row matches
+   */
+  static bool Next(State state, unsigned event, State &target) noexcept {
+    auto index = static_cast<unsigned long long>(state);
+    if (index >= states)
+      return false;
+    auto cell = Cells::Target(Cells::Class(index) * kEvents + event);
+    if (cell == kNoCell)
+      return false;
+    target = static_cast<State>(cell);
+    return true;
+  }
+};
+}
+
+/**
+ * Finite state machine (FSM) base class template.
+ *
+ * TODO use *atomic* bool instead of raw bool as default.
+ * Note that this class *does not* guarantee thread safe by default.
+ *
+ * @tparam Derived the derived state machine class
+ * @tparam State the FSM's state type, default to `int`
+ * @tparam AtomicBoolType the atomic bool type to implement processing lock, default to `bool`;
+ *         an atomic template like `std::atomic<bool>` is instantiated with the
+ *         owning thread instead, so that other threads wait for the lock
+ * @tparam MutexType the read-write mutex type, default to a no-op mutex
+ * @tparam StateStorage the state storage policy, default to `detail::PlainState`;
+ *         see `fsm/atomic_state.h` for storages which can be read without locking
+ * @tparam Statistics the statistics policy, default to `detail::NoStatistics`;
+ *         see `fsm/statistics.h` for per-row counters and action latency histograms
+ * @tparam ErrorPolicy the error policy, default to `detail::DefaultErrorPolicy`
+ */
+template<class Derived, class State = int,
+    class AtomicBoolType = bool,
+    class MutexType = detail::DefaultRWMutex,
+    class StateStorage = detail::PlainState<State>,
+    class Statistics = detail::NoStatistics,
+    class ErrorPolicy = detail::DefaultErrorPolicy>
+class FSM {
+ public:
+  /**
+   * The FSM's state type.
+   */
+  using StateType = State;
+
+  /**
+   * The type of the counter returned by `StateVersion()`.
+   */
+  using VersionType = typename StateStorage::VersionType;
+
+  /**
+   * The return type of `Dispatch()`, defined by the error policy.
+   */
+  using DispatchResultType = typename ErrorPolicy::template ResultType<State>;
+
+  /**
+   * The statistics policy.
+   */
+  using StatisticsType = Statistics;
+
+  /**
+   * The distinct event types of `Derived::TransitionTable`, as a `detail::List`,
+   * not counting the pseudo event of `CompletionRow`s.
+   * It is a template only to defer the lookup until `Derived` is complete;
+   * use it as `EventTypes<>`.
+   */
+  template<class D = Derived>
+  using EventTypes = typename detail::EventTypesOf<typename D::TransitionTable>::Type;
+
+  /**
+   * Result of `PeekTransition()`.
+   */
+  struct PeekResult {
+    /**
+     * Whether a row matched; if not, `target` is the current state and
+     * `NoTransition()` would decide the actual outcome.
+     */
+    bool matched;
+    /**
+     * The state the FSM would move to.
+     */
+    StateType target;
+    /**
+     * Index of the matched row in `Derived::TransitionTable`.
+     */
+    unsigned row;
+  };
+
+ public:
+  /**
+   * Create a finite state machine with an optional initial state.
+   *
+   * @param initial_state the FSM's initial state.
+   */
+  explicit FSM(StateType init_state = StateType{}) : state_(init_state) {}
+
+  /**
+   * Dispatch an event.
+   *
+   * This method is `noexcept` if the guards and actions of the event's rows,
+   * `NoTransition()`, the mutex and the error policy are.
+   *
+   * @warning This method shouldn't be called recursively; doing so is reported
+   *          through the error policy.
+   * @tparam Event the event type
+   * @param event the optional event instance
+   * @return FSM's state after dispatching the event, wrapped by the error policy.
+   */
+  template<class Event>
+  DispatchResultType Dispatch(const Event &event = Event{})
+  noexcept(IsNothrowExecute<typename TransitionOf<Event>::Type, Event>::value && IsNothrowDispatch<>::value) {
+    static_assert(detail::IsBaseOf<FSM, Derived>::value, "must derive from fsm");
+    return DispatchWith<typename TransitionOf<Event>::Type>(event);
+  }
+
+  /**
+   * Dispatch an event.
+   *
+   * @warning This method shouldn't be called recursively.
+   * @tparam Event the event type
+   * @param event the optional event instance
+   * @return FSM's state after dispatching the event.
+   */
+  template<class Event>
+  DispatchResultType operator()(const Event &event)
+  noexcept(IsNothrowExecute<typename TransitionOf<Event>::Type, Event>::value && IsNothrowDispatch<>::value) {
+    return Dispatch(event);
+  }
+
+  /**
+   * Get current state of the state machine.
+   *
+   * @return current state
+   */
+  StateType CurrentState() const {
+    return LoadState(typename StateStorage::WaitFree{});
+  }
+
+  /**
+   * Get a counter which is bumped every time the state changes, so that
+   * pollers can skip machines whose state is unchanged since the last scan.
+   *
+   * @return current state version
+   */
+  VersionType StateVersion() const {
+    return LoadVersion(typename StateStorage::WaitFree{});
+  }
+
+  /**
+   * Block until the state machine is in `state` or `timeout` elapsed.
+   *
+   * Requires a state storage policy supporting waits, such as
+   * `WaitableState` from `fsm/atomic_state.h`.
+   *
+   * @param state the state to wait for
+   * @param timeout a `std::chrono::duration`
+   * @return whether the state machine is in `state`
+   */
+  template<class Duration>
+  bool WaitForState(StateType state, const Duration &timeout) const {
+    return state_.WaitUntil([state](const StateType &current) { return current == state; }, timeout);
+  }
+
+  /**
+   * Block until `predicate(CurrentState())` holds or `timeout` elapsed.
+   *
+   * Requires a state storage policy supporting waits, see `WaitForState()`.
+   *
+   * @param predicate callable taking the state
+   * @param timeout a `std::chrono::duration`
+   * @return whether the predicate holds
+   */
+  template<class Predicate, class Duration>
+  bool WaitUntil(Predicate predicate, const Duration &timeout) const {
+    return state_.WaitUntil(predicate, timeout);
+  }
+
+  /**
+   * Find the transition an event would take, without dispatching it.
+   *
+   * Only guards are run, under the read lock so that they never race with
+   * a concurrent `Dispatch()`; actions and `NoTransition()` are not run, the
+   * write lock is not taken and the processing lock is left untouched.
+   *
+   * @warning Actions and guards run while `Dispatch()` holds the write lock,
+   *          so they must call `PeekLocked()` instead.
+   *
+   * @tparam Event the event type
+   * @param event the optional event instance
+   * @return the matched row and its target state
+   */
+  template<class Event>
+  PeekResult PeekTransition(const Event &event = Event{}) const {
+    static_assert(detail::IsBaseOf<FSM, Derived>::value, "must derive from fsm");
+
+    detail::RWMutexInterface::Guard<true> mutex_lock_guard(mutex_);
+    return PeekLocked(event);
+  }
+
+  /**
+   * Check whether `Derived::TransitionTable` has a row for `Event` starting
+   * at `state`, regardless of guards.
+   *
+   * @tparam Event the event type
+   * @param state the start state
+   * @return whether dispatching `Event` in `state` may take a transition
+   */
+  template<class Event>
+  static bool HasTransition(StateType state) noexcept {
+    using rows = typename ByEventType<Event, typename Derived::TransitionTable>::Type;
+
+    return AnyStartsAt<rows>::Execute(state);
+  }
+
+  /**
+   * Map a state to the canonical state of its class in the minimized
+   * `Derived::TransitionTable`, see `kMinimizeTable`. `CurrentState()` is
+   * canonical only after transitions whose target depends on more than the
+   * class, so compare `CanonicalState()` of both sides.
+   *
+   * @tparam D defers the lookup until `Derived` is complete
+   * @param state a state
+   * @return the smallest state equivalent to `state`
+   */
+  template<class D = Derived>
+  static constexpr StateType CanonicalState(StateType state) {
+    return MinimalTableOf<D>::Type::Canonical(state);
+  }
+
+  /**
+   * Number of states of the minimized `Derived::TransitionTable`.
+   */
+  template<class D = Derived>
+  static constexpr unsigned CanonicalStateCount() {
+    return MinimalTableOf<D>::Type::kClasses;
+  }
+
+  /**
+   * Bytes of static data the minimized dispatch reads: the class of each
+   * state, and the target of each class and event.
+   */
+  template<class D = Derived>
+  static constexpr unsigned long long MinimalTableBytes() {
+    return MinimalTableOf<D>::Type::kBytes;
+  }
+
+  /**
+   * Run `PeekTransition()` over a range of candidate machines.
+   *
+   * @tparam Event the event type
+   * @param first, last the range of machines, either `Derived` or pointers to `Derived`
+   * @param event the event instance
+   * @param out the output iterator receiving one `PeekResult` per machine
+   * @return output iterator past the last written element
+   */
+  template<class Event, class InputIterator, class OutputIterator>
+  static OutputIterator PeekTransitions(InputIterator first, InputIterator last,
+                                        const Event &event, OutputIterator out) {
+    for (; first != last; ++first, ++out)
+      *out = AsMachine(*first).PeekTransition(event);
+    return out;
+  }
+
+ protected:
+  /**
+   * Called when no transition can be found for the given event
+   * in the current state. Derived state machine may override
+   * this to throw an exception, or change to some other state.
+   * The default is to return current state, so no state change occurs.
+   *
+   * @tparam Event
+   * @param event
+   * @return
+   */
+  template<class Event>
+  StateType NoTransition(const Event &event) noexcept {
+    return state_.Load();
+  }
+
+  /**
+   * Called by `Dispatch()` after the state changed, while the write lock is
+   * still held. Derived state machine may override this to keep external
+   * indexes (see `fsm/registry.h`) in sync. The default does nothing.
+   *
+   * @param from the previous state
+   * @param to the new state
+   */
+  void OnStateChange(StateType /*from*/, StateType /*to*/) noexcept {}
+
+  /**
+   * `PeekTransition()` without taking any lock, for callers already inside
+   * the FSM's lock: actions, guards and `NoTransition()`. During an action
+   * the state is still the one the transition started from.
+   *
+   * @tparam Event the event type
+   * @param event the event instance
+   * @return the matched row and its target state
+   */
+  template<class Event>
+  PeekResult PeekLocked(const Event &event) const {
+    using rows = typename ByEventType<Event, typename Derived::TransitionTable>::Type;
+
+    return PeekEvent<Event, rows>::Execute(static_cast<const Derived &>(*this), event, state_.Load());
+  }
+
+  /**
+   * Maximum number of `CompletionRow` transitions taken after one event.
+   * Derived state machine may hide this with its own constant; if completion
+   * rows still match after that many steps, `Dispatch()` stops there and
+   * reports `DispatchError::kCompletionLimit` through the error policy.
+   */
+  static constexpr unsigned kMaxCompletionDepth = 16;
+
+  /**
+   * Whether `Dispatch()` runs on a minimized copy of `Derived::TransitionTable`.
+   * Derived state machine may hide this with its own constant set to `true`
+   * if its rows have neither guards nor actions.
+   *
+   * Equivalent states (for every event, both have no row or both move to
+   * equivalent states) are merged at compile time into a dense table of one
+   * row per class, shared by all instances, see `CanonicalState()`. A
+   * transition moves to the target of the original row if all states of the
+   * class move there, and to the canonical state of the target's class if
+   * they move to different equivalent states. States must be integral or
+   * enumeration values in [0, 256), and a table with `AnyState` rows covers
+   * all of them. The statistics policy must be `detail::NoStatistics`, since
+   * this path has no rows to count; `NoTransition()` is still called.
+   */
+  static constexpr bool kMinimizeTable = false;
+
+  /**
+   * Dispatch an event through `Transition::Execute(self, event, state)`,
+   * which returns the new state, instead of through the rows of
+   * `Derived::TransitionTable`. Locking, error handling and `OnStateChange()`
+   * are the same as for `Dispatch()`. Headers generated by `fsmc` dispatch
+   * through this.
+   *
+   * @tparam Transition the transition function
+   * @tparam Event the event type
+   * @param event the event instance
+   * @return FSM's state after dispatching the event, wrapped by the error policy.
+   */
+  template<class Transition, class Event>
+  DispatchResultType DispatchWith(const Event &event)
+  noexcept(IsNothrowExecute<Transition, Event>::value && IsNothrowDispatch<>::value) {
+    ProcessingLockGuard processing_lock_guard(*this);
+    if (!processing_lock_guard.Locked())
+      return ErrorPolicy::Failure(DispatchError::kRecursiveDispatch, state_.Load());
+
+    auto &self = static_cast<Derived &>(*this);
+    auto previous = state_.Load();
+    auto state = Transition::Execute(self, event, previous);
+    auto completed = Complete(self, state, CompletionRows<>{});
+    state_.Store(state);
+    if (!(state == previous))
+      self.OnStateChange(previous, state);
+
+    if (!completed)
+      return ErrorPolicy::Failure(DispatchError::kCompletionLimit, state);
+    return ErrorPolicy::Success(state);
+  }
+
+ private:
+  template<class T>
+  using IsOrdered = detail::IntegralConstant<bool, std::is_integral<T>::value || std::is_enum<T>::value>;
+
+  template<class Event, State target>
+  struct RowCommon {
+    using StateType = State;
+    using EventType = Event;
+    using HasEventValue = detail::FalseType;
+
+    static constexpr StateType TargetValue() { return target; }
+
+   protected:
+    template<class Action>
+    static void ProcessEvent(Action &&action, Derived &self, const Event &event)
+    noexcept(noexcept(detail::InvokeAsBinaryFn(action, self, event))) {
+      detail::InvokeAsBinaryFn(action, self, event);
+    }
+
+    static /*constexpr*/ void ProcessEvent(detail::NullPointerType, Derived &self, const Event &event) noexcept {
+    }
+
+    template<class Guard>
+    static bool CheckGuard(Guard &&guard, const Derived &self, const Event &event)
+    noexcept(noexcept(detail::InvokeAsBinaryFn(guard, self, event))) {
+      return detail::InvokeAsBinaryFn(guard, self, event);
+    }
+
+    static constexpr bool CheckGuard(detail::NullPointerType, const Derived &, const Event &) noexcept {
+      return true;
+    }
+  };
+
+  // Rows starting from one state.
+  template<State start, class Event, State target>
+  struct RowBase : public RowCommon<Event, target> {
+    using StartRank = detail::IntegralConstant<unsigned, 0>;
+
+    static constexpr State StartValue() { return start; }
+    static constexpr bool MatchesStart(State state) { return state == start; }
+  };
+
+  // Rows starting from a set of states, see `StateSet` and `AnyState`.
+  template<class StartSet, class Event, State target>
+  struct RowSetBase : public RowCommon<Event, target> {
+    using Starts = StartSet;
+    using StartRank = typename Starts::Rank;
+
+    static constexpr bool MatchesStart(State state) { return Starts::Matches(state); }
+  };
+
+  template<class Base, class Event, class Action, Action action, class Guard, Guard guard>
+  struct BasicRowImpl : public Base {
+    using IsPlain = detail::IntegralConstant<bool, detail::IsSame<Action, detail::NullPointerType>::value
+        && detail::IsSame<Guard, detail::NullPointerType>::value>;
+
+    static void ProcessEvent(Derived &self, const Event &event)
+    noexcept(noexcept(Base::ProcessEvent(action, self, event))) {
+      Base::ProcessEvent(action, self, event);
+    }
+
+    static bool CheckGuard(const Derived &self, const Event &event)
+    noexcept(noexcept(Base::CheckGuard(guard, self, event))) {
+      return Base::CheckGuard(guard, self, event);
+    }
+  };
+
+  template<class Base, class Event, void (Derived::*action)(const Event &), bool (Derived::*guard)(const Event &) const>
+  struct MemFnRowImpl : public Base {
+    using IsPlain = detail::IntegralConstant<bool, action == nullptr && guard == nullptr>;
+
+    // Member function pointer types do not carry `noexcept` before C++17 (and
+    // the parameters above never do), so only absent actions/guards are nothrow.
+    static void ProcessEvent(Derived &self, const Event &event) noexcept(action == nullptr) {
+      if (action != nullptr)
+        Base::ProcessEvent(action, self, event);
+    }
+
+    static bool CheckGuard(const Derived &self, const Event &event) noexcept(guard == nullptr) {
+      if (guard != nullptr)
+        return Base::CheckGuard(guard, self, event);
+      return true;
+    }
+  };
+
+ protected:
+  /**
+   * Transition table variadic class template.
+   *
+   * Each derived state machine class *should* define a nested
+   * non-template type `TransitionTable` which is either derived from a
+   * type or a type alias of Table.
+   */
+  template<class... Rows>
+  using Table = detail::List<Rows...>;
+
+  /**
+   * Start specifier matching every state, for `BasicRowFrom` and `MemFnRowFrom`.
+   *
+   * Rows starting from `AnyState` are only tried after the rows starting
+   * from a single state and the rows starting from `StateSet<...>`.
+   */
+  struct AnyState {
+    using Rank = detail::IntegralConstant<unsigned, 2>;
+
+    static constexpr bool Matches(State) { return true; }
+  };
+
+  /**
+   * Start specifier matching a set of states, for `BasicRowFrom` and `MemFnRowFrom`.
+   * The current state is matched by a single bit test against the set.
+   *
+   * Rows starting from `StateSet<...>` are only tried after the rows starting
+   * from a single state.
+   *
+   * @tparam states the start states, of an integral or enumeration type in [0, 64)
+   */
+  template<State... states>
+  struct StateSet {
+    static_assert(IsOrdered<State>::value, "StateSet<...> needs an integral or enumeration state type");
+    static_assert(detail::All<(static_cast<unsigned long long>(states) < 64)...>::value,
+                  "StateSet<...> only holds states in [0, 64)");
+
+    using Rank = detail::IntegralConstant<unsigned, 1>;
+    using Mask = detail::BitOr<(1ull << static_cast<unsigned long long>(states))...>;
+
+    static constexpr bool Matches(State state) {
+      return static_cast<unsigned long long>(state) < 64
+          && ((Mask::value >> static_cast<unsigned long long>(state)) & 1u) != 0;
+    }
+  };
+
+  /**
+   * Basic transition class template.
+   *
+   * @tparam start the start state of the transition
+   * @tparam Event the event type of the transition
+   * @tparam target the target state of the transition
+   * @tparam Action a callable action function type or `detail::NullPointerType`
+   * @tparam action a static `Action` instance
+   * @tparam Guard a callable guard function type or `detail::NullPointerType`
+   * @tparam guard a static `Guard` instance
+   */
+  template<
+      State start,
+      class Event,
+      State target,
+      class Action = detail::NullPointerType,
+      Action action = nullptr,
+      class Guard = detail::NullPointerType,
+      Guard guard = nullptr
+  >
+  struct BasicRow : public BasicRowImpl<RowBase<start, Event, target>, Event, Action, action, Guard, guard> {};
+
+  /**
+   * Basic transition class template starting from a set of states.
+   *
+   * @tparam Starts `AnyState` or `StateSet<...>`
+   * @tparam Event the event type of the transition
+   * @tparam target the target state of the transition
+   * @tparam Action a callable action function type or `detail::NullPointerType`
+   * @tparam action a static `Action` instance
+   * @tparam Guard a callable guard function type or `detail::NullPointerType`
+   * @tparam guard a static `Guard` instance
+   */
+  template<
+      class Starts,
+      class Event,
+      State target,
+      class Action = detail::NullPointerType,
+      Action action = nullptr,
+      class Guard = detail::NullPointerType,
+      Guard guard = nullptr
+  >
+  struct BasicRowFrom : public BasicRowImpl<RowSetBase<Starts, Event, target>, Event, Action, action, Guard, guard> {};
+
+  /**
+   * Basic transition class template.
+   *
+   * @tparam start the start state of the transition
+   * @tparam Event the event type of the transition
+   * @tparam target the target state of the transition
+   * @tparam action an action member function or `nullptr`
+   * @tparam guard a guard member function or `nullptr`
+   */
+  template<
+      State start,
+      class Event,
+      State target,
+      void (Derived::*action)(const Event &) = nullptr,
+      bool (Derived::*guard)(const Event &) const = nullptr
+  >
+  struct MemFnRow : public MemFnRowImpl<RowBase<start, Event, target>, Event, action, guard> {};
 
   /**
-   * Basic transition class template.
+   * Member function transition class template starting from a set of states.
+   *
+   * @tparam Starts `AnyState` or `StateSet<...>`
+   * @tparam Event the event type of the transition
+   * @tparam target the target state of the transition
+   * @tparam action an action member function or `nullptr`
+   * @tparam guard a guard member function or `nullptr`
+   */
+  template<
+      class Starts,
+      class Event,
+      State target,
+      void (Derived::*action)(const Event &) = nullptr,
+      bool (Derived::*guard)(const Event &) const = nullptr
+  >
+  struct MemFnRowFrom : public MemFnRowImpl<RowSetBase<Starts, Event, target>, Event, action, guard> {};
+
+  /**
+   * Transition class template matching a compile-time event value, for
+   * integral or enumeration event types. Rows matching on values are
+   * located by a jump table or binary search over the values instead of
+   * evaluating a guard per value.
    *
    * @tparam start the start state of the transition
    * @tparam Event the event type of the transition
+   * @tparam value the event value of the transition
    * @tparam target the target state of the transition
    * @tparam action an action member function or `nullptr`
    * @tparam guard a guard member function or `nullptr`
@@ -500,19 +1532,54 @@ class FSM {
   template<
       State start,
       class Event,
+      Event value,
       State target,
       void (Derived::*action)(const Event &) = nullptr,
       bool (Derived::*guard)(const Event &) const = nullptr
   >
-  struct MemFnRow : public RowBase<start, Event, target> {
-    static void ProcessEvent(Derived &self, const Event &event) {
+  struct ValueRow : public MemFnRow<start, Event, target, action, guard> {
+    using HasEventValue = detail::TrueType;
+    using IsPlain = detail::FalseType;
+
+    static constexpr Event EventValue() { return value; }
+
+    static bool CheckGuard(const Derived &self, const Event &event) noexcept(guard == nullptr) {
+      return event == value && MemFnRow<start, Event, target, action, guard>::CheckGuard(self, event);
+    }
+  };
+
+  /**
+   * Eventless transition class template, for states which only decide where
+   * to go next.
+   *
+   * After every dispatched event, still under the same locks, the completion
+   * rows starting from the resulting state are tried in table order and the
+   * first one whose guard holds is taken, until none matches or
+   * `kMaxCompletionDepth` rows were taken. The state is published, and
+   * `OnStateChange()` called, once for the whole chain.
+   *
+   * @tparam start the start state of the transition
+   * @tparam target the target state of the transition
+   * @tparam action an action member function or `nullptr`
+   * @tparam guard a guard member function or `nullptr`
+   */
+  template<
+      State start,
+      State target,
+      void (Derived::*action)() = nullptr,
+      bool (Derived::*guard)() const = nullptr
+  >
+  struct CompletionRow : public RowBase<start, detail::CompletionEvent, target> {
+    using IsPlain = detail::FalseType;
+
+    static void ProcessEvent(Derived &self, const detail::CompletionEvent &) noexcept(action == nullptr) {
       if (action != nullptr)
-        RowBase<start, Event, target>::ProcessEvent(action, self, event);
+        (self.*action)();
     }
 
-    static bool CheckGuard(const Derived &self, const Event &event) {
+    static bool CheckGuard(const Derived &self, const detail::CompletionEvent &) noexcept(guard == nullptr) {
       if (guard != nullptr)
-        return RowBase<start, Event, target>::CheckGuard(guard, self, event);
+        return (self.*guard)();
       return true;
     }
   };
@@ -521,10 +1588,22 @@ class FSM {
   template<class Event, class...>
   struct ByEventType;
 
+  // Rows of an event, most specific start first: rows starting from a
+  // single state, then from `StateSet<...>`, then from `AnyState`, each in
+  // table order.
   template<class Event, class... Types>
   struct ByEventType<Event, detail::List<Types...>> {
-    template<class T> using Predicate = detail::IsSame<typename T::EventType, Event>;
-    using Type = typename detail::Filter<Predicate, Types...>::Type;
+    template<unsigned rank>
+    struct Ranked {
+      template<class T> using Predicate = detail::IntegralConstant<bool,
+          detail::IsSame<typename T::EventType, Event>::value && T::StartRank::value == rank>;
+      using Type = typename detail::Filter<Predicate, Types...>::Type;
+    };
+
+    using Type = typename detail::Join<
+        typename Ranked<0>::Type,
+        typename detail::Join<typename Ranked<1>::Type, typename Ranked<2>::Type>::Type
+    >::Type;
   };
 
   template<class Event>
@@ -532,14 +1611,25 @@ class FSM {
     using Type = detail::List<>;
   };
 
+  // Whether `Handler::Execute()` is `noexcept`; the dispatch steps below
+  // are as `noexcept` as the steps they forward to.
+  template<class Handler, class Event>
+  using IsNothrowExecute = detail::IntegralConstant<bool, noexcept(Handler::Execute(
+      detail::DeclVal<Derived &>(), detail::DeclVal<const Event &>(), detail::DeclVal<State>()))>;
+
   template<class Event, class...>
   struct HandleEvent;
 
   template<class Event, class T, class... Types>
   struct HandleEvent<Event, detail::List<T, Types...>> {
-    static State Execute(Derived &self, const Event &event, State state) {
-      if (state == T::StartValue() && T::CheckGuard(self, event)) {
-        T::ProcessEvent(self, event);
+    static State Execute(Derived &self, const Event &event, State state)
+    noexcept(noexcept(T::CheckGuard(self, event))
+        && noexcept(Statistics::template Transition<T, detail::IndexOf<T, typename Derived::TransitionTable>::value>(
+            self, event, state))
+        && IsNothrowExecute<HandleEvent<Event, detail::List<Types...>>, Event>::value) {
+      if (T::MatchesStart(state) && T::CheckGuard(self, event)) {
+        using index = detail::IndexOf<T, typename Derived::TransitionTable>;
+        Statistics::template Transition<T, index::value>(self, event, state);
         return T::TargetValue();
       }
       return HandleEvent<Event, detail::List<Types...>>::Execute(self, event, state);
@@ -548,45 +1638,707 @@ class FSM {
 
   template<class Event>
   struct HandleEvent<Event, detail::List<>> {
-    static State Execute(Derived &self, const Event &event, State) {
+    static State Execute(Derived &self, const Event &event, State state)
+    noexcept(noexcept(Statistics::template NoTransition<Derived, Event>(state)) && noexcept(self.NoTransition(event))) {
+      Statistics::template NoTransition<Derived, Event>(state);
+      return self.NoTransition(event);
+    }
+  };
+
+  template<class Rows, class = void>
+  struct IsNothrowComplete;
+
+  template<class T, class... Rows>
+  struct IsNothrowComplete<detail::List<T, Rows...>, void> : detail::All<
+      noexcept(T::CheckGuard(detail::DeclVal<const Derived &>(), detail::DeclVal<const detail::CompletionEvent &>())),
+      noexcept(Statistics::template Transition<T, detail::IndexOf<T, typename Derived::TransitionTable>::value>(
+          detail::DeclVal<Derived &>(), detail::DeclVal<const detail::CompletionEvent &>(), detail::DeclVal<State>())),
+      IsNothrowComplete<detail::List<Rows...>>::value,
+      noexcept(ErrorPolicy::Failure(DispatchError::kCompletionLimit, detail::DeclVal<State>()))
+  > {};
+
+  template<class Void>
+  struct IsNothrowComplete<detail::List<>, Void> : detail::TrueType {};
+
+  // Whether the steps around the transition function are `noexcept`.
+  template<class D = Derived>
+  struct IsNothrowDispatch : detail::All<
+      noexcept(ErrorPolicy::Failure(DispatchError::kRecursiveDispatch, detail::DeclVal<State>())),
+      noexcept(detail::DeclVal<MutexType &>().Lock()),
+      noexcept(detail::DeclVal<MutexType &>().Unlock()),
+      noexcept(detail::DeclVal<StateStorage &>().Store(detail::DeclVal<State>())),
+      noexcept(detail::DeclVal<D &>().OnStateChange(detail::DeclVal<State>(), detail::DeclVal<State>())),
+      IsNothrowComplete<typename ByEventType<detail::CompletionEvent, typename D::TransitionTable>::Type>::value
+  > {};
+
+  template<class D = Derived>
+  using CompletionRows = typename ByEventType<detail::CompletionEvent, typename D::TransitionTable>::Type;
+
+  template<class Rows, class = void>
+  struct CompleteStep;
+
+  template<class T, class... Types>
+  struct CompleteStep<detail::List<T, Types...>, void> {
+    // Take the first matching completion row from `state`, if any.
+    static bool Execute(Derived &self, State &state) {
+      if (T::MatchesStart(state) && T::CheckGuard(self, detail::CompletionEvent{})) {
+        using index = detail::IndexOf<T, typename Derived::TransitionTable>;
+        Statistics::template Transition<T, index::value>(self, detail::CompletionEvent{}, state);
+        state = T::TargetValue();
+        return true;
+      }
+      return CompleteStep<detail::List<Types...>>::Execute(self, state);
+    }
+
+    static bool Matches(const Derived &self, State state) {
+      return (T::MatchesStart(state) && T::CheckGuard(self, detail::CompletionEvent{}))
+          || CompleteStep<detail::List<Types...>>::Matches(self, state);
+    }
+  };
+
+  template<class Void>
+  struct CompleteStep<detail::List<>, Void> {
+    static bool Execute(Derived &, State &) noexcept { return false; }
+    static bool Matches(const Derived &, State) noexcept { return false; }
+  };
+
+  /**
+   * Run the completion rows from `state`, leaving the final state in it.
+   *
+   * @return false if the chain was cut at `kMaxCompletionDepth`
+   */
+  static bool Complete(Derived &, State &, detail::List<>) noexcept { return true; }
+
+  template<class... Rows>
+  static bool Complete(Derived &self, State &state, detail::List<Rows...>) {
+    using Step = CompleteStep<detail::List<Rows...>>;
+    for (unsigned depth = 0; depth < Derived::kMaxCompletionDepth; ++depth)
+      if (!Step::Execute(self, state))
+        return true;
+    return !Step::Matches(self, state);
+  }
+
+  template<class Event, class...>
+  struct PeekEvent;
+
+  template<class Event, class...>
+  struct RunRow;
+
+  template<class Event, class T, class... Types>
+  struct RunRow<Event, detail::List<T, Types...>> {
+    static void Execute(Derived &self, const Event &event, State state, unsigned row) {
+      using index = detail::IndexOf<T, typename Derived::TransitionTable>;
+      if (row == index::value)
+        Statistics::template Transition<T, index::value>(self, event, state);
+      else
+        RunRow<Event, detail::List<Types...>>::Execute(self, event, state, row);
+    }
+  };
+
+  template<class Event>
+  struct RunRow<Event, detail::List<>> {
+    static void Execute(Derived &, const Event &, State, unsigned) {}
+  };
+
+  template<class Event, class T, class... Types>
+  struct PeekEvent<Event, detail::List<T, Types...>> {
+    static PeekResult Execute(const Derived &self, const Event &event, State state) {
+      if (T::MatchesStart(state) && T::CheckGuard(self, event))
+        return PeekResult{true, T::TargetValue(), detail::IndexOf<T, typename Derived::TransitionTable>::value};
+      return PeekEvent<Event, detail::List<Types...>>::Execute(self, event, state);
+    }
+  };
+
+  template<class Event>
+  struct PeekEvent<Event, detail::List<>> {
+    static PeekResult Execute(const Derived &, const Event &, State state) {
+      return PeekResult{false, state, 0};
+    }
+  };
+
+  template<class Rows, class = void>
+  struct AnyStartsAt;
+
+  template<class T, class... Types>
+  struct AnyStartsAt<detail::List<T, Types...>, void> {
+    static bool Execute(State state) noexcept {
+      return T::MatchesStart(state) || AnyStartsAt<detail::List<Types...>>::Execute(state);
+    }
+  };
+
+  template<class Void>
+  struct AnyStartsAt<detail::List<>, Void> {
+    static bool Execute(State) noexcept { return false; }
+  };
+
+  static const FSM &AsMachine(const FSM &machine) { return machine; }
+  static const FSM &AsMachine(const FSM *machine) { return *machine; }
+
+  /**
+   * `HandleEvent` scans an event's rows one after another. Once the rows
+   * of an event start from more than `kLinearDispatchLimit` distinct states,
+   * they are grouped by start state and the group is found either through a
+   * jump table indexed by the state (if the start states are dense) or through
+   * a branchless binary search over the sorted start states (otherwise).
+   * Within a group, `ValueRow`s are located the same way by event value; a
+   * value only sees the rows matching it plus the rows matching any value.
+   * Rows of one group keep their relative order, so guards are still checked
+   * in table order. Rows starting from a set of states join every group
+   * whose state they match, after the group's own rows, and form the group
+   * of states no other row starts from.
+   */
+  static constexpr unsigned kLinearDispatchLimit = 4;
+  static constexpr unsigned kDenseDispatchLimit = 256;
+  static constexpr unsigned kDenseDispatchFactor = 4;
+
+  template<State s>
+  struct StartIs {
+    template<class T> using Predicate = detail::IntegralConstant<bool, T::MatchesStart(s)>;
+  };
+
+  template<State s, class...>
+  struct RowsFrom;
+
+  template<State s, class... Types>
+  struct RowsFrom<s, detail::List<Types...>> {
+    using Type = typename detail::Filter<StartIs<s>::template Predicate, Types...>::Type;
+  };
+
+  template<class Rows, bool = IsOrdered<State>::value>
+  struct StartsOf {
+    using Type = detail::List<>;
+  };
+
+  template<class...>
+  struct SingleStartsOf;
+
+  template<class... Types>
+  struct SingleStartsOf<detail::List<Types...>> {
+    using Type = typename detail::SortedUnique<detail::IntegralConstant<State, Types::StartValue()>...>::Type;
+  };
+
+  template<class T>
+  using IsSingleStart = detail::IntegralConstant<bool, T::StartRank::value == 0>;
+
+  // Start states of the rows starting from a single state.
+  template<class... Types>
+  struct StartsOf<detail::List<Types...>, true> {
+    using Type = typename SingleStartsOf<typename detail::Filter<IsSingleStart, Types...>::Type>::Type;
+  };
+
+  template<class T>
+  using IsSetRow = detail::IntegralConstant<bool, T::StartRank::value != 0>;
+
+  template<class...>
+  struct SetRows;
+
+  template<class... Types>
+  struct SetRows<detail::List<Types...>> {
+    using Type = typename detail::Filter<IsSetRow, Types...>::Type;
+  };
+
+  template<class T>
+  using HasEventValue = typename T::HasEventValue;
+
+  template<class T>
+  using IsWildcard = detail::IntegralConstant<bool, !T::HasEventValue::value>;
+
+  template<class Row, class Value, bool = Row::HasEventValue::value>
+  struct MatchesValue : detail::TrueType {};
+
+  template<class Row, class Value>
+  struct MatchesValue<Row, Value, true> : detail::IntegralConstant<bool, Row::EventValue() == Value::value> {};
+
+  template<class Value>
+  struct ValueIs {
+    template<class T> using Predicate = MatchesValue<T, Value>;
+  };
+
+  template<class Value, class...>
+  struct RowsFor;
+
+  template<class Value, class... Types>
+  struct RowsFor<Value, detail::List<Types...>> {
+    using Type = typename detail::Filter<ValueIs<Value>::template Predicate, Types...>::Type;
+  };
+
+  template<class...>
+  struct WildcardRows;
+
+  template<class... Types>
+  struct WildcardRows<detail::List<Types...>> {
+    using Type = typename detail::Filter<IsWildcard, Types...>::Type;
+  };
+
+  template<class Event, class...>
+  struct ValuesOf;
+
+  template<class Event, class... Types>
+  struct ValuesOf<Event, detail::List<Types...>> {
+    using Type = typename ValuesOf<Event, typename detail::Filter<HasEventValue, Types...>::Type, void>::Type;
+  };
+
+  template<class Event, class... ValueRows>
+  struct ValuesOf<Event, detail::List<ValueRows...>, void> {
+    using Type = typename detail::SortedUnique<detail::IntegralConstant<Event, ValueRows::EventValue()>...>::Type;
+  };
+
+  template<class Handler>
+  struct Unkeyed {
+    template<class Event, class Key>
+    static State Execute(Derived &self, const Event &event, State state, const Key &)
+    noexcept(IsNothrowExecute<Handler, Event>::value) {
+      return Handler::Execute(self, event, state);
+    }
+  };
+
+  template<class Event, class Keys, template<class> class HandlerOf, class Default>
+  struct SparseDispatch;
+
+  template<class Event, class... Keys, template<class> class HandlerOf, class Default>
+  struct SparseDispatch<Event, detail::List<Keys...>, HandlerOf, Default> {
+    template<class Key>
+    static State Execute(Derived &self, const Event &event, State state, const Key &key)
+    noexcept(detail::All<IsNothrowExecute<HandlerOf<Keys>, Event>::value...,
+                         IsNothrowExecute<Default, Event>::value>::value) {
+      using Handler = State (*)(Derived &, const Event &, State);
+      static const Key keys[] = {Keys::value...};
+      static const Handler handlers[] = {&HandlerOf<Keys>::Execute...};
+
+      unsigned base = 0, size = sizeof...(Keys);
+      while (size > 1) {
+        auto half = size / 2;
+        base = keys[base + half] <= key ? base + half : base;
+        size -= half;
+      }
+      if (keys[base] == key)
+        return handlers[base](self, event, state);
+      return Default::Execute(self, event, state);
+    }
+  };
+
+  template<class Event, class Key, Key min, class Offsets, template<class> class HandlerOf, class Default>
+  struct DenseDispatch;
+
+  template<class Event, class Key, Key min, unsigned... offsets, template<class> class HandlerOf, class Default>
+  struct DenseDispatch<Event, Key, min, detail::IndexSequence<offsets...>, HandlerOf, Default> {
+    template<unsigned offset>
+    using HandlerAt = HandlerOf<
+        detail::IntegralConstant<Key, static_cast<Key>(static_cast<unsigned long long>(min) + offset)>>;
+
+    static State Execute(Derived &self, const Event &event, State state, const Key &key)
+    noexcept(detail::All<IsNothrowExecute<HandlerAt<offsets>, Event>::value...,
+                         IsNothrowExecute<Default, Event>::value>::value) {
+      using Handler = State (*)(Derived &, const Event &, State);
+      static const Handler handlers[] = {&HandlerAt<offsets>::Execute...};
+
+      auto offset = static_cast<unsigned long long>(key) - static_cast<unsigned long long>(min);
+      if (offset < sizeof...(offsets))
+        return handlers[offset](self, event, state);
+      return Default::Execute(self, event, state);
+    }
+  };
+
+  /**
+   * Jump to `HandlerOf<IntegralConstant<Key, key>>` for a runtime key among
+   * the sorted distinct `Keys`, or to `Default` for other keys. Falls back to
+   * `Linear` (which ignores the key) for few keys.
+   */
+  template<class Event, class Keys, template<class> class HandlerOf, class Default, class Linear>
+  struct KeyedDispatch : Unkeyed<Linear> {};
+
+  template<class Event, class First, class... Keys, template<class> class HandlerOf, class Default, class Linear>
+  struct KeyedDispatch<Event, detail::List<First, Keys...>, HandlerOf, Default, Linear> {
+    using Key = typename First::ValueType;
+
+    static constexpr unsigned long long kRange = static_cast<unsigned long long>(
+        detail::Last<First, Keys...>::Type::value) - static_cast<unsigned long long>(First::value);
+    static constexpr unsigned kCount = 1 + sizeof...(Keys);
+    static constexpr bool kDense = kRange < kDenseDispatchLimit && kRange < kDenseDispatchFactor * kCount;
+
+    using Type = typename detail::Conditional<
+        kCount <= kLinearDispatchLimit,
+        Unkeyed<Linear>,
+        typename detail::Conditional<
+            kDense,
+            DenseDispatch<Event, Key, First::value,
+                          typename detail::MakeIndexSequence<kDense ? kRange + 1 : 0>::Type, HandlerOf, Default>,
+            SparseDispatch<Event, detail::List<First, Keys...>, HandlerOf, Default>
+        >::Type
+    >::Type;
+
+    static State Execute(Derived &self, const Event &event, State state, const Key &key)
+    noexcept(noexcept(Type::Execute(self, event, state, key))) {
+      return Type::Execute(self, event, state, key);
+    }
+  };
+
+  template<class Event, class Rows>
+  struct ByValue {
+    template<class Value> using Handler = HandleEvent<Event, typename RowsFor<Value, Rows>::Type>;
+  };
+
+  // Dispatch within rows sharing a start state (or all rows of the event).
+  template<class Event, class Rows>
+  struct GroupDispatch {
+    using Type = KeyedDispatch<
+        Event,
+        typename detail::Conditional<IsOrdered<Event>::value, typename ValuesOf<Event, Rows>::Type, detail::List<>>::Type,
+        ByValue<Event, Rows>::template Handler,
+        HandleEvent<Event, typename WildcardRows<Rows>::Type>,
+        HandleEvent<Event, Rows>
+    >;
+
+    static State Execute(Derived &self, const Event &event, State state)
+    noexcept(noexcept(Type::Execute(self, event, state, event))) {
+      return Type::Execute(self, event, state, event);
+    }
+  };
+
+  template<class Event, class Rows>
+  struct ByStart {
+    template<class Start> using Handler = GroupDispatch<Event, typename RowsFrom<Start::value, Rows>::Type>;
+  };
+
+  template<class Event, class Rows>
+  struct DispatchEvent {
+    using Type = KeyedDispatch<
+        Event,
+        typename StartsOf<Rows>::Type,
+        ByStart<Event, Rows>::template Handler,
+        GroupDispatch<Event, typename SetRows<Rows>::Type>,
+        GroupDispatch<Event, Rows>
+    >;
+
+    static State Execute(Derived &self, const Event &event, State state)
+    noexcept(noexcept(Type::Execute(self, event, state, state))) {
+      return Type::Execute(self, event, state, state);
+    }
+  };
+
+  // One past the largest state a row starts from; `AnyState` rows start
+  // from every state kMinimizeTable supports.
+  template<class T, unsigned = T::StartRank::value>
+  struct StartBound : detail::IntegralConstant<unsigned long long, 256> {};
+
+  template<class T>
+  struct StartBound<T, 0>
+      : detail::IntegralConstant<unsigned long long, static_cast<unsigned long long>(T::StartValue()) + 1> {};
+
+  template<class T>
+  struct StartBound<T, 1> : detail::IntegralConstant<unsigned long long, detail::BitLength(T::Starts::Mask::value)> {};
+
+  template<class Rows, class Events>
+  struct MinimalTableFor;
+
+  template<class... Rows, class... Events>
+  struct MinimalTableFor<detail::List<Rows...>, detail::List<Events...>> {
+    static_assert(IsOrdered<State>::value, "kMinimizeTable needs an integral or enumeration state type");
+    static_assert(detail::All<Rows::IsPlain::value...>::value,
+                  "kMinimizeTable needs rows without guards, actions, event values or completion");
+
+    using Type = detail::MinimalTable<
+        State,
+        detail::List<typename ByEventType<Events, detail::List<Rows...>>::Type...>,
+        detail::Max<StartBound<Rows>::value..., static_cast<unsigned long long>(Rows::TargetValue()) + 1 ...>::value
+    >;
+  };
+
+  template<class D = Derived>
+  struct MinimalTableOf : MinimalTableFor<typename D::TransitionTable, EventTypes<D>> {};
+
+  template<class Event>
+  struct MinimalDispatch;
+
+  // The transition function `Dispatch()` runs for `Event`.
+  template<class Event, class D = Derived>
+  struct TransitionOf {
+    using Rows = typename ByEventType<Event, typename D::TransitionTable>::Type;
+    using Type = typename detail::Conditional<
+        D::kMinimizeTable && !detail::IsSame<Rows, detail::List<>>::value,
+        MinimalDispatch<Event>,
+        DispatchEvent<Event, Rows>
+    >::Type;
+  };
+
+  template<class Event>
+  struct MinimalDispatch {
+    static State Execute(Derived &self, const Event &event, State state)
+    noexcept(noexcept(self.NoTransition(event))) {
+      static_assert(detail::IsSame<Statistics, detail::NoStatistics>::value,
+                    "kMinimizeTable doesn't call statistics hooks");
+
+      using Table = typename MinimalTableOf<>::Type;
+      using index = detail::IndexOf<Event, EventTypes<>>;
+
+      State target;
+      if (Table::Next(state, index::value, target))
+        return target;
       return self.NoTransition(event);
     }
   };
 
  private:
-  StateType state_;
+  StateType LoadState(detail::TrueType) const {
+    return state_.Load();
+  }
+
+  StateType LoadState(detail::FalseType) const {
+    detail::RWMutexInterface::Guard<true> mutex_lock_guard(mutex_);
+    return state_.Load();
+  }
+
+  VersionType LoadVersion(detail::TrueType) const {
+    return state_.Version();
+  }
+
+  VersionType LoadVersion(detail::FalseType) const {
+    detail::RWMutexInterface::Guard<true> mutex_lock_guard(mutex_);
+    return state_.Version();
+  }
+
+ private:
+  StateStorage state_;
 
  private:
+  // Takes the write lock and records the calling thread as its owner, unless
+  // that thread already owns the machine, i.e. it is dispatching from one of
+  // the machine's actions. Other threads wait for the lock.
   class ProcessingLockGuard {
    public:
-    explicit ProcessingLockGuard(FSM &m) : processing_(m.processing_) {
-      if (processing_) {
-#if defined(__cpp_exceptions)
-        throw std::logic_error("trying to lock processing lock recursively");
-#else
-#if __has_include(<cstdlib>) // for exit()
-#include <cstdlib>
-#else
-#include <stdlib.h>
-#endif
-        exit(EXIT_FAILURE);
-#endif
+    explicit ProcessingLockGuard(FSM &m) : m_(m), locked_(!m.OwnedByThisThread()) {
+      if (locked_) {
+        m_.mutex_.Lock();
+        m_.owner_ = detail::ThreadTag();
       }
-      processing_ = true; // TODO atomically compare && replace
     }
 
     ~ProcessingLockGuard() {
-      processing_ = false; // TODO atomically compare && replace
+      if (locked_) {
+        m_.owner_ = nullptr;
+        m_.mutex_.Unlock();
+      }
     }
+
+    bool Locked() const noexcept { return locked_; }
+
    private:
-    AtomicBoolType &processing_;
+    FSM &m_;
+    bool locked_;
   };
 
-  AtomicBoolType processing_ = false;
+  // Only the owner writes its own tag, so a stale value never matches.
+  bool OwnedByThisThread() const noexcept {
+    return static_cast<const void *>(owner_) == detail::ThreadTag();
+  }
+
+  typename detail::Rebind<AtomicBoolType, const void *>::Type owner_{nullptr};
 
  private:
   mutable MutexType mutex_{};
+
+ private:
+  // Transaction steps used by `DispatchAll()`.
+  friend struct detail::Transaction;
+
+  // Blocks until no other thread dispatches to the machine; fails if the
+  // calling thread does, without locking.
+  bool LockForTransaction() {
+    if (OwnedByThisThread())
+      return false;
+    mutex_.Lock();
+    owner_ = detail::ThreadTag();
+    return true;
+  }
+
+  void UnlockForTransaction() noexcept {
+    owner_ = nullptr;
+    mutex_.Unlock();
+  }
+
+  template<class Event>
+  void RunLocked(const Event &event, const PeekResult &result) {
+    using rows = typename ByEventType<Event, typename Derived::TransitionTable>::Type;
+
+    RunRow<Event, rows>::Execute(static_cast<Derived &>(*this), event, state_.Load(), result.row);
+  }
+
+  // Returns false if the completion rows were cut at `kMaxCompletionDepth`.
+  bool CommitLocked(const PeekResult &result) {
+    auto &self = static_cast<Derived &>(*this);
+    auto previous = state_.Load();
+    auto state = result.target;
+    auto completed = Complete(self, state, CompletionRows<>{});
+    state_.Store(state);
+    if (!(state == previous))
+      self.OnStateChange(previous, state);
+    return completed;
+  }
+};
+
+namespace detail {
+struct Transaction {
+  // A machine to lock, type erased so machines of all types can be sorted
+  // into one global lock order (by address).
+  struct Participant {
+    void *machine;
+    bool (*lock)(void *);
+    void (*unlock)(void *);
+
+    unsigned long long Key() const { return reinterpret_cast<unsigned long long>(machine); }
+  };
+
+  template<class D, class S, class A, class M, class St, class Sta, class E>
+  static FSM<D, S, A, M, St, Sta, E> &Base(FSM<D, S, A, M, St, Sta, E> &machine) noexcept { return machine; }
+
+  template<class Machine>
+  static bool Lock(void *machine) { return Base(*static_cast<Machine *>(machine)).LockForTransaction(); }
+
+  template<class Machine>
+  static void Unlock(void *machine) { Base(*static_cast<Machine *>(machine)).UnlockForTransaction(); }
+
+  static void Collect(Participant *) noexcept {}
+
+  template<class Machine, class Event, class... Rest>
+  static void Collect(Participant *out, Machine &machine, const Event &, Rest &... rest) noexcept {
+    *out = Participant{&machine, &Lock<Machine>, &Unlock<Machine>};
+    Collect(out + 1, rest...);
+  }
+
+  // Peek results of every (machine, event) pair, in argument order.
+  template<class...>
+  struct Pending;
+
+  template<class Void>
+  struct Pending<Void> {
+    Pending() = default;
+    bool Prepare() { return true; }
+    void Run() {}
+    bool Commit() { return true; }
+  };
+
+  template<class Void, class Machine, class Event, class... Rest>
+  struct Pending<Void, Machine, Event, Rest...> {
+    template<class... Args>
+    Pending(Machine &machine, const Event &event, Args &... rest)
+        : machine(machine), event(event), rest(rest...) {}
+
+    bool Prepare() {
+      result = Base(machine).PeekLocked(event);
+      return result.matched && rest.Prepare();
+    }
+
+    void Run() {
+      Base(machine).RunLocked(event, result);
+      rest.Run();
+    }
+
+    bool Commit() {
+      auto completed = Base(machine).CommitLocked(result);
+      return rest.Commit() && completed;
+    }
+
+    Machine &machine;
+    const Event &event;
+    typename Machine::PeekResult result{};
+    Pending<Void, Rest...> rest;
+  };
+
+  // Unlocks the first `count` sorted participants in reverse order.
+  struct UnlockGuard {
+    Participant *participants;
+    unsigned count;
+
+    ~UnlockGuard() {
+      while (count > 0) {
+        --count;
+        participants[count].unlock(participants[count].machine);
+      }
+    }
+  };
+};
+}
+
+/**
+ * Outcome of `DispatchAll()`.
+ */
+enum class TransactionResult {
+  /**
+   * Every machine took its transition.
+   */
+  kCommitted,
+  /**
+   * Some event had no matching row, or a machine appeared twice.
+   */
+  kRejected,
+  /**
+   * `DispatchAll()` was called from an action of one of its machines, which
+   * was still dispatching. Nothing was locked for that machine.
+   */
+  kBusy,
+  /**
+   * Every machine took its transition, but the completion rows of some were
+   * cut at `kMaxCompletionDepth`, as with `DispatchError::kCompletionLimit`.
+   * All states, including those the completion rows stopped in, are committed.
+   */
+  kCompletionLimit,
 };
+
+/**
+ * Dispatch events to several machines as one transaction: either every
+ * machine takes a transition, or none of them changes.
+ *
+ * The machines' write locks are taken in a global order (by address),
+ * waiting for concurrent dispatches and transactions, so transactions and
+ * `Dispatch()` calls from other threads never deadlock nor fail on each other. Then the
+ * guards of all pairs are checked; only if every event has a matching row,
+ * the actions run in argument order and all target states are committed
+ * together. `NoTransition()` is never called.
+ *
+ * @warning Actions should not throw: if one does, actions of earlier pairs
+ *          have already run while no state has been committed.
+ * @param args pairs of machine and event: `DispatchAll(m1, e1, m2, e2, ...)`
+ * @return whether the transaction was committed, rejected, or found a machine busy
+ *         dispatching on the calling thread
+ */
+template<class... Args>
+TransactionResult DispatchAll(Args &&... args) {
+  static_assert(sizeof...(Args) % 2 == 0, "DispatchAll takes pairs of machine and event");
+  static_assert(sizeof...(Args) > 0, "DispatchAll takes at least one machine");
+
+  constexpr unsigned kMachines = sizeof...(Args) / 2;
+  detail::Transaction::Participant participants[kMachines];
+  detail::Transaction::Collect(participants, args...);
+
+  // insertion sort; transactions span a handful of machines
+  for (unsigned i = 1; i < kMachines; ++i) {
+    auto participant = participants[i];
+    auto j = i;
+    for (; j > 0 && participants[j - 1].Key() > participant.Key(); --j)
+      participants[j] = participants[j - 1];
+    participants[j] = participant;
+  }
+  // locking a machine twice would deadlock
+  for (unsigned i = 1; i < kMachines; ++i) {
+    if (participants[i - 1].machine == participants[i].machine)
+      return TransactionResult::kRejected;
+  }
+
+  detail::Transaction::UnlockGuard unlock_guard{participants, 0};
+  for (auto &participant : participants) {
+    if (!participant.lock(participant.machine))
+      return TransactionResult::kBusy;
+    ++unlock_guard.count;
+  }
+
+  detail::Transaction::Pending<void, typename detail::RemoveReference<Args>::Type...> pending(args...);
+  if (!pending.Prepare())
+    return TransactionResult::kRejected;
+  pending.Run();
+  if (!pending.Commit())
+    return TransactionResult::kCompletionLimit;
+  return TransactionResult::kCommitted;
+}
 }
 
 #endif //FSM_INCLUDE_FSM_FSM_H_
@@ -0,0 +1,209 @@
+// Copyright 2020 方泓睿
+//
+// 	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// 	documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#ifndef FSM_INCLUDE_FSM_REGISTRY_H_
+#define FSM_INCLUDE_FSM_REGISTRY_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "fsm.h"
+
+// A registry of machines indexed by their current state, so that an event
+// can be broadcast to the machines able to react to it without visiting
+// every instance. It requires a hosted implementation (<vector>), so it
+// lives outside of `fsm.h`.
+
+namespace fsm {
+/**
+ * Set of machines of one type, partitioned by current state.
+ *
+ * Every registered machine gets a dense id; for each state seen so far the
+ * registry keeps a bitmap over those ids. Machines report their transitions
+ * by calling `Moved()` from `OnStateChange()`:
+ *
+ *     void OnStateChange(StateType from, StateType to) {
+ *       registry_.Moved(id_, from, to);
+ *     }
+ *
+ * Note that the registry *does not* guarantee thread safe; machines sharing a
+ * registry must not dispatch concurrently.
+ *
+ * @tparam Machine the derived state machine class
+ */
+template<class Machine>
+class MachineRegistry {
+ public:
+  using StateType = typename Machine::StateType;
+  using Id = unsigned;
+
+  /**
+   * Register a machine under its current state.
+   *
+   * @return the id the machine passes to `Moved()` and `Remove()`
+   */
+  Id Add(Machine &machine) {
+    Id id;
+    if (free_.empty()) {
+      id = static_cast<Id>(machines_.size());
+      machines_.push_back(&machine);
+    } else {
+      id = free_.back();
+      free_.pop_back();
+      machines_[id] = &machine;
+    }
+    Insert(BucketOf(machine.CurrentState()), id);
+    return id;
+  }
+
+  /**
+   * Unregister a machine; its id may be handed out again by `Add()` once no
+   * `Broadcast()` is running.
+   */
+  void Remove(Id id) {
+    Erase(BucketOf(machines_[id]->CurrentState()), id);
+    machines_[id] = nullptr;
+    (broadcasts_ == 0 ? free_ : removed_).push_back(id);
+  }
+
+  /**
+   * Move a machine from the set of `from` to the set of `to`.
+   */
+  void Moved(Id id, StateType from, StateType to) {
+    Erase(BucketOf(from), id);
+    Insert(BucketOf(to), id);
+  }
+
+  /**
+   * @return number of registered machines currently in `state`
+   */
+  std::size_t Count(StateType state) const noexcept {
+    for (auto &bucket : buckets_) {
+      if (bucket.state == state)
+        return bucket.count;
+    }
+    return 0;
+  }
+
+  /**
+   * Dispatch an event to every machine whose current state has a row for it
+   * in `Machine::TransitionTable`. Machines in other states are not touched.
+   * Each machine receives the event at most once, even if it moves into
+   * another accepting state on the way. Machines removed while the event
+   * is broadcast (e.g. from an action) are skipped.
+   *
+   * @tparam Event the event type
+   * @param event the optional event instance
+   * @return number of machines the event was dispatched to
+   */
+  template<class Event>
+  std::size_t Broadcast(const Event &event = Event{}) {
+    // an action may broadcast again; it gets its own buffer
+    std::vector<Id> targets;
+    targets.swap(targets_);
+    targets.clear();
+    for (auto &bucket : buckets_) {
+      if (bucket.count == 0 || !Machine::template HasTransition<Event>(bucket.state))
+        continue;
+      for (std::size_t word = 0; word < bucket.bits.size(); ++word) {
+        for (auto bits = bucket.bits[word]; bits != 0; bits &= bits - 1)
+          targets.push_back(static_cast<Id>(word * kWordBits + CountTrailingZeros(bits)));
+      }
+    }
+
+    BroadcastGuard guard(*this);
+    std::size_t dispatched = 0;
+    for (auto id : targets) {
+      if (machines_[id] == nullptr)
+        continue;
+      machines_[id]->Dispatch(event);
+      ++dispatched;
+    }
+    targets_.swap(targets);
+    return dispatched;
+  }
+
+ private:
+  using Word = std::uint64_t;
+
+  static constexpr unsigned kWordBits = 64;
+
+  struct Bucket {
+    StateType state;
+    std::vector<Word> bits;
+    std::size_t count;
+  };
+
+  // Ids removed during a broadcast are only freed after it, so that a
+  // machine added meanwhile can't take the id of a pending target.
+  class BroadcastGuard {
+   public:
+    explicit BroadcastGuard(MachineRegistry &registry) : registry_(registry) { ++registry_.broadcasts_; }
+
+    ~BroadcastGuard() {
+      if (--registry_.broadcasts_ != 0)
+        return;
+      registry_.free_.insert(registry_.free_.end(), registry_.removed_.begin(), registry_.removed_.end());
+      registry_.removed_.clear();
+    }
+
+    BroadcastGuard(const BroadcastGuard &) = delete;
+    BroadcastGuard &operator=(const BroadcastGuard &) = delete;
+
+   private:
+    MachineRegistry &registry_;
+  };
+
+  static unsigned CountTrailingZeros(Word word) noexcept {
+#if defined(__GNUC__)
+    return static_cast<unsigned>(__builtin_ctzll(word));
+#else
+    unsigned n = 0;
+    for (; (word & 1u) == 0; word >>= 1)
+      ++n;
+    return n;
+#endif
+  }
+
+  // States are few, so a linear scan beats hashing (and needs no std::hash
+  // for enums, which C++11 lacks).
+  Bucket &BucketOf(StateType state) {
+    for (auto &bucket : buckets_) {
+      if (bucket.state == state)
+        return bucket;
+    }
+    buckets_.push_back(Bucket{state, {}, 0});
+    return buckets_.back();
+  }
+
+  static void Insert(Bucket &bucket, Id id) {
+    if (bucket.bits.size() <= id / kWordBits)
+      bucket.bits.resize(id / kWordBits + 1);
+    bucket.bits[id / kWordBits] |= Word{1} << (id % kWordBits);
+    ++bucket.count;
+  }
+
+  static void Erase(Bucket &bucket, Id id) noexcept {
+    bucket.bits[id / kWordBits] &= ~(Word{1} << (id % kWordBits));
+    --bucket.count;
+  }
+
+  std::vector<Machine *> machines_;
+  std::vector<Id> free_;
+  std::vector<Bucket> buckets_;
+  std::vector<Id> removed_;
+  std::vector<Id> targets_;
+  unsigned broadcasts_ = 0;
+};
+}
+
+#endif //FSM_INCLUDE_FSM_REGISTRY_H_
@@ -0,0 +1,672 @@
+// Copyright 2020 方泓睿
+//
+// 	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// 	documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef FSM_INCLUDE_FSM_RUNTIME_FSM_H_
+#define FSM_INCLUDE_FSM_RUNTIME_FSM_H_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Finite state machines whose transition table is loaded at runtime.
+//
+// A table is described in a line based text format:
+//
+//   # comment
+//   states <state>...
+//   events <event>...
+//   <start> <event> <target> [<action> | -] [<guard> | -]
+//
+// Action and guard names are resolved against a `RuntimeRegistry` of
+// functions registered by the program. At load time the rows are compiled
+// into a dense [state][event] -> row range array, so dispatching is one
+// indexed load followed by a scan over the rows of that (state, event) pair.
+//
+// Machines either keep a fixed table (`FixedTableSource`) or read the table
+// of a `RuntimeTableHandle` (`SharedTableSource`), which can be replaced
+// while machines are dispatching; see `RuntimeTableHandle`.
+
+namespace fsm {
+/**
+ * Registry of named actions and guards a `RuntimeTable` may refer to.
+ *
+ * @tparam Derived the derived state machine class
+ * @tparam Event the event payload type
+ */
+template<class Derived, class Event>
+class RuntimeRegistry {
+ public:
+  using ActionType = void (*)(Derived &, const Event &);
+  using GuardType = bool (*)(const Derived &, const Event &);
+
+  RuntimeRegistry &AddAction(const std::string &name, ActionType action) {
+    actions_[name] = action;
+    return *this;
+  }
+
+  template<void (Derived::*action)(const Event &)>
+  RuntimeRegistry &AddAction(const std::string &name) {
+    return AddAction(name, [](Derived &self, const Event &event) { (self.*action)(event); });
+  }
+
+  RuntimeRegistry &AddGuard(const std::string &name, GuardType guard) {
+    guards_[name] = guard;
+    return *this;
+  }
+
+  template<bool (Derived::*guard)(const Event &) const>
+  RuntimeRegistry &AddGuard(const std::string &name) {
+    return AddGuard(name, [](const Derived &self, const Event &event) { return (self.*guard)(event); });
+  }
+
+  ActionType FindAction(const std::string &name) const {
+    auto it = actions_.find(name);
+    return it == actions_.end() ? nullptr : it->second;
+  }
+
+  GuardType FindGuard(const std::string &name) const {
+    auto it = guards_.find(name);
+    return it == guards_.end() ? nullptr : it->second;
+  }
+
+ private:
+  std::unordered_map<std::string, ActionType> actions_;
+  std::unordered_map<std::string, GuardType> guards_;
+};
+
+/**
+ * A compiled, immutable runtime transition table.
+ *
+ * @tparam Derived the derived state machine class
+ * @tparam Event the event payload type
+ */
+template<class Derived, class Event>
+class RuntimeTable {
+ public:
+  using RegistryType = RuntimeRegistry<Derived, Event>;
+  using ActionType = typename RegistryType::ActionType;
+  using GuardType = typename RegistryType::GuardType;
+  using StateId = unsigned;
+  using EventId = unsigned;
+
+  /**
+   * Map a state name of a previous table to a state name of this table.
+   */
+  using StateMapper = std::function<std::string(const std::string &)>;
+
+  struct Row {
+    StateId start;
+    EventId event;
+    StateId target;
+    ActionType action;
+    GuardType guard;
+  };
+
+  /**
+   * Compile a table from its states, events and rows.
+   * Rows sharing a (start, event) pair keep their relative order.
+   */
+  RuntimeTable(std::vector<std::string> states, std::vector<std::string> events, std::vector<Row> rows)
+      : RuntimeTable(std::move(states), std::move(events), std::move(rows), std::vector<StateId>{}) {}
+
+  /**
+   * Parse and compile a table from its text description.
+   *
+   * @throw std::invalid_argument if the description is malformed or refers to unknown names
+   */
+  static std::shared_ptr<const RuntimeTable> Parse(const std::string &text, const RegistryType &registry) {
+    std::vector<std::string> states, events;
+    std::unordered_map<std::string, StateId> state_ids;
+    std::unordered_map<std::string, EventId> event_ids;
+    std::vector<Row> rows;
+
+    std::istringstream input(text);
+    std::string line;
+    for (unsigned line_no = 1; std::getline(input, line); ++line_no) {
+      auto comment = line.find('#');
+      if (comment != std::string::npos)
+        line.erase(comment);
+
+      std::istringstream words(line);
+      std::vector<std::string> tokens;
+      for (std::string token; words >> token;)
+        tokens.push_back(token);
+      if (tokens.empty())
+        continue;
+
+      auto fail = [line_no](const std::string &what) {
+        throw std::invalid_argument("line " + std::to_string(line_no) + ": " + what);
+      };
+
+      if (tokens[0] == "states" || tokens[0] == "events") {
+        auto &names = tokens[0] == "states" ? states : events;
+        for (std::size_t i = 1; i < tokens.size(); ++i) {
+          auto &ids = tokens[0] == "states" ? state_ids : event_ids;
+          if (!ids.emplace(tokens[i], static_cast<unsigned>(names.size())).second)
+            fail("duplicate name '" + tokens[i] + "'");
+          names.push_back(tokens[i]);
+        }
+        continue;
+      }
+
+      if (tokens.size() < 3 || tokens.size() > 5)
+        fail("expected '<start> <event> <target> [<action>] [<guard>]'");
+
+      auto lookup = [&fail](const std::unordered_map<std::string, unsigned> &ids,
+                            const std::string &kind, const std::string &name) -> unsigned {
+        auto it = ids.find(name);
+        if (it == ids.end())
+          fail("unknown " + kind + " '" + name + "'");
+        return it->second;
+      };
+
+      Row row{lookup(state_ids, "state", tokens[0]),
+              lookup(event_ids, "event", tokens[1]),
+              lookup(state_ids, "state", tokens[2]),
+              nullptr, nullptr};
+      if (tokens.size() > 3 && tokens[3] != "-" && (row.action = registry.FindAction(tokens[3])) == nullptr)
+        fail("unknown action '" + tokens[3] + "'");
+      if (tokens.size() > 4 && tokens[4] != "-" && (row.guard = registry.FindGuard(tokens[4])) == nullptr)
+        fail("unknown guard '" + tokens[4] + "'");
+      rows.push_back(row);
+    }
+
+    if (states.empty())
+      throw std::invalid_argument("table declares no states");
+
+    return std::make_shared<const RuntimeTable>(std::move(states), std::move(events), std::move(rows));
+  }
+
+  /**
+   * Lay this table out again so that every state and event index of
+   * `previous` keeps its meaning, and machines running on `previous` can
+   * switch to the result without translating their state.
+   *
+   * A state of `previous` is carried over to the state of this table named
+   * `mapper(name)` (or `name` without mapper). If several states map to the
+   * same state, the later ones become aliases sharing its rows and name.
+   * Events of `previous` missing in this table keep their index without rows.
+   *
+   * @throw std::invalid_argument if a state of `previous` maps to no state of this table
+   */
+  std::shared_ptr<const RuntimeTable> Rebase(const RuntimeTable &previous, const StateMapper &mapper = nullptr) const {
+    const auto kNone = std::numeric_limits<StateId>::max();
+
+    std::vector<std::string> states, events;
+    std::vector<StateId> aliases, state_index(states_.size(), kNone);
+    for (StateId i = 0; i < previous.states_.size(); ++i) {
+      auto name = mapper ? mapper(previous.states_[i]) : previous.states_[i];
+      auto it = state_ids_.find(name);
+      if (it == state_ids_.end())
+        throw std::invalid_argument("state '" + previous.states_[i] + "' maps to unknown state '" + name + "'");
+      if (state_index[it->second] == kNone)
+        state_index[it->second] = i;
+      aliases.push_back(state_index[it->second]);
+      states.push_back(name);
+    }
+    for (StateId i = 0; i < states_.size(); ++i) {
+      if (state_index[i] != kNone)
+        continue;
+      state_index[i] = static_cast<StateId>(states.size());
+      aliases.push_back(state_index[i]);
+      states.push_back(states_[i]);
+    }
+
+    std::vector<EventId> event_index(events_.size(), kNone);
+    events = previous.events_;
+    for (EventId i = 0; i < events.size(); ++i) {
+      auto it = event_ids_.find(events[i]);
+      if (it != event_ids_.end())
+        event_index[it->second] = i;
+    }
+    for (EventId i = 0; i < events_.size(); ++i) {
+      if (event_index[i] != kNone)
+        continue;
+      event_index[i] = static_cast<EventId>(events.size());
+      events.push_back(events_[i]);
+    }
+
+    std::vector<Row> rows;
+    rows.reserve(rows_.size());
+    for (auto row : rows_) {
+      row.start = state_index[row.start];
+      row.event = event_index[row.event];
+      row.target = state_index[row.target];
+      rows.push_back(row);
+    }
+
+    return std::shared_ptr<const RuntimeTable>(
+        new RuntimeTable(std::move(states), std::move(events), std::move(rows), std::move(aliases)));
+  }
+
+  std::size_t StateCount() const { return states_.size(); }
+  std::size_t EventCount() const { return events_.size(); }
+
+  /**
+   * Name of a state; aliases created by `Rebase()` report the name of the state they alias.
+   */
+  const std::string &StateName(StateId state) const { return states_.at(state); }
+  const std::string &EventName(EventId event) const { return events_.at(event); }
+
+  /**
+   * @throw std::out_of_range if the state is unknown
+   */
+  StateId StateIndex(const std::string &name) const { return state_ids_.at(name); }
+
+  /**
+   * @throw std::out_of_range if the event is unknown
+   */
+  EventId EventIndex(const std::string &name) const { return event_ids_.at(name); }
+
+  /**
+   * Rows of the (state, event) pair, in table order; empty if either is
+   * out of range.
+   */
+  std::pair<const Row *, const Row *> Rows(StateId state, EventId event) const {
+    if (state >= states_.size() || event >= events_.size())
+      return {nullptr, nullptr};
+    auto cell = state * events_.size() + event;
+    return {rows_.data() + offsets_[cell], rows_.data() + offsets_[cell + 1]};
+  }
+
+ private:
+  RuntimeTable(std::vector<std::string> states, std::vector<std::string> events,
+               std::vector<Row> rows, std::vector<StateId> aliases)
+      : states_(std::move(states)), events_(std::move(events)) {
+    for (StateId i = 0; i < states_.size(); ++i)
+      state_ids_.emplace(states_[i], i);
+    for (EventId i = 0; i < events_.size(); ++i)
+      event_ids_.emplace(events_[i], i);
+
+    // an alias gets its own copy of the rows of the state it aliases,
+    // so that dispatching from it needs no extra indirection
+    auto primaries = rows.size();
+    for (StateId alias = 0; alias < aliases.size(); ++alias) {
+      if (aliases[alias] == alias)
+        continue;
+      for (std::size_t i = 0; i < primaries; ++i) {
+        if (rows[i].start == aliases[alias]) {
+          rows.push_back(rows[i]);
+          rows.back().start = alias;
+        }
+      }
+    }
+    Compile(rows);
+  }
+
+  void Compile(const std::vector<Row> &rows) {
+    auto cells = states_.size() * events_.size();
+    offsets_.assign(cells + 1, 0);
+    for (auto &row : rows)
+      ++offsets_[row.start * events_.size() + row.event + 1];
+    for (std::size_t i = 0; i < cells; ++i)
+      offsets_[i + 1] += offsets_[i];
+
+    // counting sort keeps rows of the same cell in table order
+    std::vector<unsigned> cursor(offsets_.begin(), offsets_.end() - 1);
+    rows_.resize(rows.size());
+    for (auto &row : rows)
+      rows_[cursor[row.start * events_.size() + row.event]++] = row;
+  }
+
+  std::vector<std::string> states_;
+  std::vector<std::string> events_;
+  std::unordered_map<std::string, StateId> state_ids_;
+  std::unordered_map<std::string, EventId> event_ids_;
+  std::vector<Row> rows_;
+  std::vector<unsigned> offsets_;
+};
+
+namespace detail {
+/**
+ * Process wide epoch based reclamation domain.
+ *
+ * Each thread owns a slot holding the epoch at which its outermost read-side
+ * critical section started (0 when outside of one). An object retired at
+ * epoch `e` may be freed once every active slot holds an epoch above `e`.
+ */
+class EpochDomain {
+ public:
+  static EpochDomain &Instance() {
+    static EpochDomain domain;
+    return domain;
+  }
+
+  void Enter() {
+    auto &slot = LocalSlot();
+    if (slot.depth++ != 0)
+      return;
+    // publish the epoch, then make sure it didn't advance before the slot
+    // became visible to `OldestActive()`
+    auto epoch = epoch_.load(std::memory_order_acquire);
+    for (;;) {
+      slot.epoch.store(epoch, std::memory_order_seq_cst);
+      auto current = epoch_.load(std::memory_order_seq_cst);
+      if (current == epoch)
+        break;
+      epoch = current;
+    }
+  }
+
+  void Exit() {
+    auto &slot = LocalSlot();
+    if (--slot.depth == 0)
+      slot.epoch.store(0, std::memory_order_release);
+  }
+
+  /**
+   * Start a new epoch; returns the epoch objects unlinked before the call
+   * are retired at.
+   */
+  std::uint64_t Advance() {
+    return epoch_.fetch_add(1, std::memory_order_seq_cst);
+  }
+
+  /**
+   * The oldest epoch a reader may still be in.
+   */
+  std::uint64_t OldestActive() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto oldest = std::numeric_limits<std::uint64_t>::max();
+    for (auto slot : slots_) {
+      auto epoch = slot->epoch.load(std::memory_order_seq_cst);
+      if (epoch != 0 && epoch < oldest)
+        oldest = epoch;
+    }
+    return oldest;
+  }
+
+ private:
+  struct Slot {
+    explicit Slot(EpochDomain &domain) : domain(domain) {
+      std::lock_guard<std::mutex> lock(domain.mutex_);
+      domain.slots_.push_back(this);
+    }
+
+    ~Slot() {
+      std::lock_guard<std::mutex> lock(domain.mutex_);
+      for (auto it = domain.slots_.begin(); it != domain.slots_.end(); ++it) {
+        if (*it == this) {
+          domain.slots_.erase(it);
+          break;
+        }
+      }
+    }
+
+    EpochDomain &domain;
+    std::atomic<std::uint64_t> epoch{0};
+    unsigned depth = 0;
+  };
+
+  EpochDomain() = default;
+
+  Slot &LocalSlot() {
+    static thread_local Slot slot(*this);
+    return slot;
+  }
+
+  std::atomic<std::uint64_t> epoch_{1};
+  std::mutex mutex_;
+  std::vector<Slot *> slots_;
+};
+}
+
+/**
+ * A replaceable `RuntimeTable` shared by many machines.
+ *
+ * Readers load the current table through a single atomic pointer inside an
+ * epoch based read-side critical section. `Publish()` swaps the pointer and
+ * retires the old table, which is freed once every dispatch that may still
+ * use it has finished.
+ *
+ * @warning The handle must outlive every machine reading it.
+ * @tparam Derived the derived state machine class
+ * @tparam Event the event payload type
+ */
+template<class Derived, class Event>
+class RuntimeTableHandle {
+ public:
+  using TableType = RuntimeTable<Derived, Event>;
+  using StateMapper = typename TableType::StateMapper;
+
+  class ReadGuard {
+   public:
+    explicit ReadGuard(const RuntimeTableHandle &handle) {
+      detail::EpochDomain::Instance().Enter();
+      table_ = handle.current_.load(std::memory_order_seq_cst);
+    }
+
+    ~ReadGuard() {
+      detail::EpochDomain::Instance().Exit();
+    }
+
+    ReadGuard(const ReadGuard &) = delete;
+    ReadGuard &operator=(const ReadGuard &) = delete;
+
+    const TableType &Table() const { return *table_; }
+
+   private:
+    const TableType *table_;
+  };
+
+ public:
+  explicit RuntimeTableHandle(std::shared_ptr<const TableType> table)
+      : current_(table.get()), owner_(std::move(table)) {}
+
+  RuntimeTableHandle(const RuntimeTableHandle &) = delete;
+  RuntimeTableHandle &operator=(const RuntimeTableHandle &) = delete;
+
+  /**
+   * Replace the current table with `table` rebased onto it (see
+   * `RuntimeTable::Rebase()`), so machines keep their state across the swap.
+   *
+   * @throw std::invalid_argument if a current state maps to no state of `table`
+   */
+  void Publish(const TableType &table, const StateMapper &mapper = nullptr) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto rebased = table.Rebase(*owner_, mapper);
+    current_.store(rebased.get(), std::memory_order_seq_cst);
+    retired_.push_back(Retired{std::move(owner_), detail::EpochDomain::Instance().Advance()});
+    owner_ = std::move(rebased);
+    ReclaimLocked();
+  }
+
+  /**
+   * Free retired tables no dispatch can use anymore.
+   *
+   * @return number of tables still waiting to be freed
+   */
+  std::size_t Reclaim() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return ReclaimLocked();
+  }
+
+ private:
+  struct Retired {
+    std::shared_ptr<const TableType> table;
+    std::uint64_t epoch;
+  };
+
+  std::size_t ReclaimLocked() {
+    auto oldest = detail::EpochDomain::Instance().OldestActive();
+    std::vector<Retired> waiting;
+    for (auto &retired : retired_) {
+      if (retired.epoch >= oldest)
+        waiting.push_back(std::move(retired));
+    }
+    retired_.swap(waiting);
+    return retired_.size();
+  }
+
+  std::atomic<const TableType *> current_;
+  std::mutex mutex_;
+  std::shared_ptr<const TableType> owner_;
+  std::vector<Retired> retired_;
+};
+
+/**
+ * Table source of a `RuntimeFSM` owning a fixed table.
+ */
+template<class Derived, class Event>
+class FixedTableSource {
+ public:
+  using TableType = RuntimeTable<Derived, Event>;
+
+  class ReadGuard {
+   public:
+    explicit ReadGuard(const FixedTableSource &source) : table_(*source.table_) {}
+
+    const TableType &Table() const { return table_; }
+
+   private:
+    const TableType &table_;
+  };
+
+  FixedTableSource(std::shared_ptr<const TableType> table) : table_(std::move(table)) {}
+
+ private:
+  std::shared_ptr<const TableType> table_;
+};
+
+/**
+ * Table source of a `RuntimeFSM` reading the table of a `RuntimeTableHandle`.
+ */
+template<class Derived, class Event>
+class SharedTableSource {
+ public:
+  using TableType = RuntimeTable<Derived, Event>;
+
+  class ReadGuard : public RuntimeTableHandle<Derived, Event>::ReadGuard {
+   public:
+    explicit ReadGuard(const SharedTableSource &source)
+        : RuntimeTableHandle<Derived, Event>::ReadGuard(*source.handle_) {}
+  };
+
+  SharedTableSource(const RuntimeTableHandle<Derived, Event> &handle) : handle_(&handle) {}
+
+ private:
+  const RuntimeTableHandle<Derived, Event> *handle_;
+};
+
+/**
+ * Finite state machine base class template driven by a `RuntimeTable`.
+ *
+ * @tparam Derived the derived state machine class
+ * @tparam Event the event payload type passed to actions and guards
+ * @tparam TableSource where the table is read from, `FixedTableSource` or `SharedTableSource`
+ */
+template<class Derived, class Event, class TableSource = FixedTableSource<Derived, Event>>
+class RuntimeFSM {
+ public:
+  using TableType = RuntimeTable<Derived, Event>;
+  using RegistryType = RuntimeRegistry<Derived, Event>;
+  using StateType = typename TableType::StateId;
+  using EventId = typename TableType::EventId;
+
+ public:
+  /**
+   * Create a finite state machine running on the given table.
+   *
+   * @param source the shared transition table, or the handle to read it from
+   * @param init_state the FSM's initial state
+   */
+  explicit RuntimeFSM(TableSource source, StateType init_state = 0)
+      : source_(std::move(source)), state_(init_state) {}
+
+  /**
+   * Dispatch an event.
+   *
+   * @warning This method shouldn't be called recursively.
+   * An `event_id` out of the table's range has no rows, so it goes to
+   * `NoTransition()`.
+   *
+   * @param event_id the event's index in the table
+   * @param event the optional event payload
+   * @return FSM's state after dispatching the event.
+   */
+  StateType Dispatch(EventId event_id, const Event &event = Event{}) {
+    if (processing_)
+      throw std::logic_error("trying to lock processing lock recursively");
+    processing_ = true;
+    struct Reset {
+      bool &flag;
+      ~Reset() { flag = false; }
+    } reset{processing_};
+
+    typename TableSource::ReadGuard guard(source_);
+    table_ = &guard.Table();
+    auto &self = static_cast<Derived &>(*this);
+    auto rows = table_->Rows(state_, event_id);
+    for (auto row = rows.first; row != rows.second; ++row) {
+      if (row->guard == nullptr || row->guard(self, event)) {
+        if (row->action != nullptr)
+          row->action(self, event);
+        return state_ = row->target;
+      }
+    }
+    return state_ = self.NoTransition(event_id, event);
+  }
+
+  /**
+   * Dispatch an event by name.
+   *
+   * @throw std::out_of_range if the event is unknown
+   */
+  StateType Dispatch(const std::string &event_name, const Event &event = Event{}) {
+    EventId event_id;
+    {
+      typename TableSource::ReadGuard guard(source_);
+      event_id = guard.Table().EventIndex(event_name);
+    }
+    return Dispatch(event_id, event);
+  }
+
+  StateType CurrentState() const { return state_; }
+
+  std::string CurrentStateName() const {
+    typename TableSource::ReadGuard guard(source_);
+    return guard.Table().StateName(state_);
+  }
+
+ protected:
+  /**
+   * The table being dispatched on; only valid inside actions, guards and `NoTransition()`.
+   */
+  const TableType &Table() const { return *table_; }
+
+ protected:
+  /**
+   * Called when no transition can be found for the given event
+   * in the current state. Derived state machine may hide this.
+   * The default is to return current state, so no state change occurs.
+   */
+  StateType NoTransition(EventId, const Event &) {
+    return state_;
+  }
+
+ private:
+  TableSource source_;
+  const TableType *table_ = nullptr;
+  StateType state_;
+  bool processing_ = false;
+};
+}
+
+#endif //FSM_INCLUDE_FSM_RUNTIME_FSM_H_
@@ -0,0 +1,523 @@
+// Copyright 2020 方泓睿
+//
+// 	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// 	documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#ifndef FSM_INCLUDE_FSM_SESSIONIZER_H_
+#define FSM_INCLUDE_FSM_SESSIONIZER_H_
+
+#if !defined(__unix__)
+#error "fsm/sessionizer.h requires a POSIX system"
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fsm.h"
+
+// Offline replay of a keyed event log, running one state machine per key.
+//
+// The log is a memory-mapped array of fixed-size `Record`s. Keys are
+// partitioned by hash across threads in two passes: each thread first scans
+// contiguous slices of the log and buckets record offsets by partition,
+// then replays one partition by walking its buckets slice by slice, so the
+// events of one key are replayed in log order and the log is read once.
+// Offsets are 32 bits relative to their slice, so a slice holds at most
+// 2^32 records.
+// Each partition keeps its machines in an open-addressing table,
+// constructed in place inside arena chunks.
+
+namespace fsm {
+/**
+ * Batch engine replaying a keyed event log through one machine per key.
+ *
+ * `Machine` must provide `Dispatch(event_id, payload)` and `CurrentState()`
+ * (a `RuntimeFSM<Derived, Payload>` does). Outputs are binary arrays of
+ * `Transition` and `FinalState` records; records of one key keep log order,
+ * records of different keys are interleaved arbitrarily.
+ *
+ * Besides the mapped log and the machines, `Run()` keeps a 4-byte offset per
+ * record until the replay ends: a quarter of the log's size with the
+ * default 16-byte `Record`.
+ *
+ * @tparam Machine the state machine class
+ * @tparam Payload the event payload type, must be trivially copyable
+ */
+template<class Machine, class Payload = std::uint32_t>
+class Sessionizer {
+ public:
+  using StateType = typename Machine::StateType;
+
+  /**
+   * One log entry; the log file is a plain array of these.
+   */
+  struct Record {
+    std::uint64_t key;
+    std::uint32_t event;
+    Payload payload;
+  };
+
+  /**
+   * Written to the transitions file whenever a record changed the state of its key.
+   */
+  struct Transition {
+    std::uint64_t key;
+    std::uint64_t record; // index of the record in the log
+    StateType from;
+    StateType to;
+  };
+
+  /**
+   * Written to the final states file once per key. Padding bytes of both
+   * output records are written as zeros.
+   */
+  struct FinalState {
+    std::uint64_t key;
+    StateType state;
+  };
+
+  struct Options {
+    /**
+     * Number of partitions, each replayed by one thread; 0 for one per core.
+     */
+    unsigned threads = 0;
+    /**
+     * Path of the transitions file; empty to skip.
+     */
+    std::string transitions_path;
+    /**
+     * Path of the final states file; empty to skip.
+     */
+    std::string final_states_path;
+    /**
+     * Number of events in the machines' table (e.g. `RuntimeTable::EventCount()`);
+     * 0 to accept any event id.
+     */
+    std::uint32_t event_count = 0;
+  };
+
+  struct Result {
+    std::uint64_t records;
+    std::uint64_t keys;
+    std::uint64_t transitions;
+  };
+
+  /**
+   * Construct the machine of `key` in `storage` (placement new).
+   */
+  using Factory = std::function<void(void *storage, std::uint64_t key)>;
+
+ public:
+  /**
+   * @param factory constructs machines, default to `Machine()`
+   */
+  explicit Sessionizer(Factory factory = [](void *storage, std::uint64_t) { new(storage) Machine(); })
+      : factory_(std::move(factory)) {}
+
+  /**
+   * Replay the log at `log_path`.
+   *
+   * @throw std::system_error if a file can't be opened, mapped or written
+   * @throw std::invalid_argument if the log size is not a multiple of `sizeof(Record)`
+   * @throw std::out_of_range if a record's event id is not below `Options::event_count`;
+   *        nothing is replayed then
+   */
+  Result Run(const std::string &log_path, const Options &options) const {
+    MappedFile log(log_path);
+    if (log.Size() % sizeof(Record) != 0)
+      throw std::invalid_argument("log size is not a multiple of the record size: " + log_path);
+
+    auto records = static_cast<const Record *>(log.Data());
+    auto count = log.Size() / sizeof(Record);
+    auto partitions = options.threads != 0 ? options.threads : std::thread::hardware_concurrency();
+    if (partitions == 0)
+      partitions = 1;
+
+    // one slice per thread, unless that needs offsets over 32 bits
+    auto slices = std::max<std::uint64_t>(partitions, (count + kMaxSliceRecords - 1) / kMaxSliceRecords);
+    std::vector<std::uint64_t> begins(slices + 1);
+    for (std::uint64_t slice = 0; slice <= slices; ++slice)
+      begins[slice] = count / slices * slice + std::min<std::uint64_t>(slice, count % slices);
+
+    // buckets[slice][partition] holds the offsets of the slice's records
+    // belonging to the partition, in log order
+    std::vector<std::vector<Bucket>> buckets(slices, std::vector<Bucket>(partitions));
+    Parallel(partitions, [&](unsigned thread) {
+      for (auto slice = std::uint64_t{thread}; slice < slices; slice += partitions)
+        Scan(records, begins[slice], begins[slice + 1], options.event_count, buckets[slice]);
+    });
+
+    OutputFile transitions(options.transitions_path);
+    OutputFile final_states(options.final_states_path);
+
+    std::vector<Result> results(partitions, Result{0, 0, 0});
+    Parallel(partitions, [&](unsigned partition) {
+      results[partition] = Replay(records, begins, buckets, partition, transitions, final_states);
+    });
+
+    Result result{0, 0, 0};
+    for (auto &r : results) {
+      result.records += r.records;
+      result.keys += r.keys;
+      result.transitions += r.transitions;
+    }
+    return result;
+  }
+
+ private:
+  class MappedFile {
+   public:
+    explicit MappedFile(const std::string &path) {
+      auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+      if (fd < 0)
+        throw std::system_error(errno, std::generic_category(), "open " + path);
+      struct stat st{};
+      if (fstat(fd, &st) < 0) {
+        auto error = errno;
+        close(fd);
+        throw std::system_error(error, std::generic_category(), "fstat " + path);
+      }
+      size_ = static_cast<std::size_t>(st.st_size);
+      if (size_ != 0) {
+        data_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data_ == MAP_FAILED) {
+          auto error = errno;
+          close(fd);
+          throw std::system_error(error, std::generic_category(), "mmap " + path);
+        }
+        madvise(data_, size_, MADV_SEQUENTIAL);
+      }
+      close(fd);
+    }
+
+    ~MappedFile() {
+      if (size_ != 0)
+        munmap(data_, size_);
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const void *Data() const { return data_; }
+    std::size_t Size() const { return size_; }
+
+   private:
+    void *data_ = nullptr;
+    std::size_t size_ = 0;
+  };
+
+  // Shared output file; partitions append whole buffers at offsets reserved
+  // with one atomic add, so they never wait for each other.
+  class OutputFile {
+   public:
+    explicit OutputFile(const std::string &path) {
+      if (path.empty())
+        return;
+      fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+      if (fd_ < 0)
+        throw std::system_error(errno, std::generic_category(), "open " + path);
+    }
+
+    ~OutputFile() {
+      if (fd_ >= 0)
+        close(fd_);
+    }
+
+    OutputFile(const OutputFile &) = delete;
+    OutputFile &operator=(const OutputFile &) = delete;
+
+    bool Enabled() const { return fd_ >= 0; }
+
+    void Append(const std::vector<char> &buffer) {
+      auto offset = offset_.fetch_add(buffer.size(), std::memory_order_relaxed);
+      std::size_t written = 0;
+      while (written < buffer.size()) {
+        auto n = pwrite(fd_, buffer.data() + written, buffer.size() - written, static_cast<off_t>(offset + written));
+        if (n < 0) {
+          if (errno == EINTR)
+            continue;
+          throw std::system_error(errno, std::generic_category(), "pwrite");
+        }
+        written += static_cast<std::size_t>(n);
+      }
+    }
+
+   private:
+    int fd_ = -1;
+    std::atomic<std::uint64_t> offset_{0};
+  };
+
+  class Writer {
+   public:
+    explicit Writer(OutputFile &file) : file_(file) {
+      if (file_.Enabled())
+        buffer_.reserve(kBufferSize);
+    }
+
+    // Records are written field by field over zeros, so that no
+    // uninitialized padding reaches the file.
+    void Write(const Transition &value) {
+      if (!file_.Enabled())
+        return;
+      auto out = Reserve(sizeof(Transition));
+      Put(out + offsetof(Transition, key), value.key);
+      Put(out + offsetof(Transition, record), value.record);
+      Put(out + offsetof(Transition, from), value.from);
+      Put(out + offsetof(Transition, to), value.to);
+      Written();
+    }
+
+    void Write(const FinalState &value) {
+      if (!file_.Enabled())
+        return;
+      auto out = Reserve(sizeof(FinalState));
+      Put(out + offsetof(FinalState, key), value.key);
+      Put(out + offsetof(FinalState, state), value.state);
+      Written();
+    }
+
+    void Flush() {
+      if (buffer_.empty())
+        return;
+      file_.Append(buffer_);
+      buffer_.clear();
+    }
+
+   private:
+    static constexpr std::size_t kBufferSize = 1u << 20u;
+
+    std::size_t Reserve(std::size_t size) {
+      auto offset = buffer_.size();
+      buffer_.resize(offset + size);
+      return offset;
+    }
+
+    template<class T>
+    void Put(std::size_t offset, const T &field) {
+      std::memcpy(buffer_.data() + offset, &field, sizeof(T));
+    }
+
+    void Written() {
+      if (buffer_.size() >= kBufferSize)
+        Flush();
+    }
+
+    OutputFile &file_;
+    std::vector<char> buffer_;
+  };
+
+  // Machines are constructed in place in fixed-size chunks, so their
+  // addresses stay stable while the table grows.
+  class Arena {
+   public:
+    Arena() = default;
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    ~Arena() {
+      for (std::size_t i = 0; i < size_; ++i)
+        At(i)->~Machine();
+      for (auto chunk : chunks_)
+        ::operator delete(chunk);
+    }
+
+    void *Allocate() {
+      if (size_ == chunks_.size() * kChunkSize)
+        chunks_.push_back(static_cast<Slot *>(::operator new(sizeof(Slot) * kChunkSize)));
+      return &chunks_[size_ / kChunkSize][size_ % kChunkSize];
+    }
+
+    // Only call after the machine returned by `Allocate()` was constructed.
+    void Commit() { ++size_; }
+
+   private:
+    static constexpr std::size_t kChunkSize = 4096;
+
+    struct Slot {
+      alignas(Machine) unsigned char bytes[sizeof(Machine)];
+    };
+
+    Machine *At(std::size_t i) { return reinterpret_cast<Machine *>(&chunks_[i / kChunkSize][i % kChunkSize]); }
+
+    std::vector<Slot *> chunks_;
+    std::size_t size_ = 0;
+  };
+
+  // Open-addressing (linear probing) map from key to machine.
+  class Table {
+   public:
+    Table() : entries_(kInitialCapacity) {}
+
+    template<class Create>
+    Machine &FindOrCreate(std::uint64_t key, Create &&create) {
+      auto mask = entries_.size() - 1;
+      for (auto i = Hash(key) & mask;; i = (i + 1) & mask) {
+        auto &entry = entries_[i];
+        if (entry.machine == nullptr) {
+          entry.key = key;
+          entry.machine = create();
+          auto &machine = *entry.machine;
+          if (++size_ * 2 > entries_.size())
+            Grow();
+          return machine;
+        }
+        if (entry.key == key)
+          return *entry.machine;
+      }
+    }
+
+    template<class Visit>
+    void ForEach(Visit &&visit) const {
+      for (auto &entry : entries_) {
+        if (entry.machine != nullptr)
+          visit(entry.key, *entry.machine);
+      }
+    }
+
+    std::size_t Size() const { return size_; }
+
+   private:
+    static constexpr std::size_t kInitialCapacity = 1024;
+
+    struct Entry {
+      std::uint64_t key;
+      Machine *machine;
+    };
+
+    void Grow() {
+      std::vector<Entry> entries(entries_.size() * 2);
+      auto mask = entries.size() - 1;
+      for (auto &entry : entries_) {
+        if (entry.machine == nullptr)
+          continue;
+        auto i = Hash(entry.key) & mask;
+        while (entries[i].machine != nullptr)
+          i = (i + 1) & mask;
+        entries[i] = entry;
+      }
+      entries_.swap(entries);
+    }
+
+    std::vector<Entry> entries_;
+    std::size_t size_ = 0;
+  };
+
+  // splitmix64 finalizer; the low bits pick the table slot, the high bits the partition
+  static std::uint64_t Hash(std::uint64_t key) {
+    key ^= key >> 30u;
+    key *= 0xbf58476d1ce4e5b9ull;
+    key ^= key >> 27u;
+    key *= 0x94d049bb133111ebull;
+    key ^= key >> 31u;
+    return key;
+  }
+
+  using Bucket = std::vector<std::uint32_t>;
+
+  static constexpr std::uint64_t kMaxSliceRecords = 1ull << 32u;
+
+  // Run `task(0)` ... `task(n - 1)` on `n` threads and rethrow the first error.
+  template<class Task>
+  static void Parallel(unsigned n, const Task &task) {
+    std::vector<std::exception_ptr> errors(n);
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < n; ++i) {
+      threads.emplace_back([&, i] {
+        try {
+          task(i);
+        } catch (...) {
+          errors[i] = std::current_exception();
+        }
+      });
+    }
+    for (auto &thread : threads)
+      thread.join();
+    for (auto &error : errors) {
+      if (error)
+        std::rethrow_exception(error);
+    }
+  }
+
+  static void Scan(const Record *records, std::size_t begin, std::size_t end, std::uint32_t event_count,
+                   std::vector<Bucket> &buckets) {
+    auto partitions = buckets.size();
+    for (auto &bucket : buckets)
+      bucket.reserve((end - begin) / partitions + (end - begin) / partitions / 8);
+    for (auto i = begin; i < end; ++i) {
+      auto &record = records[i];
+      if (event_count != 0 && record.event >= event_count)
+        throw std::out_of_range("event id " + std::to_string(record.event) + " of record " + std::to_string(i)
+                                    + " is out of range");
+      buckets[(Hash(record.key) >> 32u) % partitions].push_back(static_cast<std::uint32_t>(i - begin));
+    }
+  }
+
+  Result Replay(const Record *records, const std::vector<std::uint64_t> &begins,
+                const std::vector<std::vector<Bucket>> &buckets, unsigned partition,
+                OutputFile &transitions_file, OutputFile &final_states_file) const {
+    Arena arena;
+    Table table;
+    Writer transitions(transitions_file);
+    Result result{0, 0, 0};
+
+    for (std::size_t slice = 0; slice < buckets.size(); ++slice) {
+      for (auto offset : buckets[slice][partition]) {
+        auto i = begins[slice] + offset;
+        auto &record = records[i];
+        ++result.records;
+        auto &machine = table.FindOrCreate(record.key, [&] {
+          auto storage = arena.Allocate();
+          factory_(storage, record.key);
+          arena.Commit();
+          return static_cast<Machine *>(storage);
+        });
+        auto from = machine.CurrentState();
+        machine.Dispatch(record.event, record.payload);
+        auto to = machine.CurrentState();
+        if (!(from == to)) {
+          ++result.transitions;
+          transitions.Write(Transition{record.key, i, from, to});
+        }
+      }
+    }
+    transitions.Flush();
+
+    Writer final_states(final_states_file);
+    table.ForEach([&](std::uint64_t key, const Machine &machine) {
+      final_states.Write(FinalState{key, machine.CurrentState()});
+    });
+    final_states.Flush();
+
+    result.keys = table.Size();
+    return result;
+  }
+
+  Factory factory_;
+};
+}
+
+#endif //FSM_INCLUDE_FSM_SESSIONIZER_H_
@@ -0,0 +1,398 @@
+// Copyright 2020 方泓睿
+//
+// 	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// 	documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef FSM_INCLUDE_FSM_STATISTICS_H_
+#define FSM_INCLUDE_FSM_STATISTICS_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+#include "fsm.h"
+#include "type_name.h"
+
+// Statistics policy recording, for every FSM type using it:
+//
+//   fsm_transitions_total{machine, row, from, to}  hits of each row
+//   fsm_state_entries_total{machine, state}        entries into each state
+//   fsm_no_transition_total{machine, state, event} `NoTransition` hits
+//   fsm_action_duration_seconds{machine, row}      sampled action latency
+//
+// Every thread records into its own shard without atomic read-modify-write
+// instructions; shards are merged when the statistics are dumped and folded
+// into a global total when their thread exits.
+
+namespace fsm {
+namespace detail {
+class StatisticsRegistry {
+ public:
+  // Latency buckets: 4 linear sub-buckets per power of two nanoseconds,
+  // up to 2^kMaxExponent ns (~68 s); larger values land in the last bucket.
+  static constexpr unsigned kSubBuckets = 4;
+  static constexpr unsigned kMaxExponent = 36;
+  static constexpr unsigned kBuckets = kSubBuckets * (kMaxExponent - 1);
+
+  static unsigned BucketOf(std::uint64_t ns) {
+    if (ns < kSubBuckets)
+      return static_cast<unsigned>(ns);
+    unsigned exponent = 63 - static_cast<unsigned>(__builtin_clzll(ns));
+    if (exponent >= kMaxExponent)
+      return kBuckets - 1;
+    auto sub = static_cast<unsigned>(ns >> (exponent - 2)) & (kSubBuckets - 1);
+    return kSubBuckets * (exponent - 1) + sub;
+  }
+
+  // Exclusive upper bound of a bucket, in nanoseconds.
+  static std::uint64_t UpperBoundOf(unsigned bucket) {
+    if (bucket < kSubBuckets)
+      return bucket + 1;
+    unsigned exponent = bucket / kSubBuckets + 1;
+    return static_cast<std::uint64_t>(kSubBuckets + bucket % kSubBuckets + 1) << (exponent - 2);
+  }
+
+  struct Histogram {
+    std::uint64_t buckets[kBuckets] = {};
+    std::uint64_t sum = 0;
+    std::uint64_t count = 0;
+  };
+
+  class Shard {
+   public:
+    explicit Shard(StatisticsRegistry &registry) : registry_(registry) {
+      std::lock_guard<std::mutex> lock(registry_.mutex_);
+      registry_.shards_.push_back(this);
+    }
+
+    ~Shard() {
+      std::lock_guard<std::mutex> lock(registry_.mutex_);
+      MergeInto(registry_.retired_counters_, registry_.retired_histograms_);
+      for (auto it = registry_.shards_.begin(); it != registry_.shards_.end(); ++it) {
+        if (*it == this) {
+          registry_.shards_.erase(it);
+          break;
+        }
+      }
+    }
+
+    Shard(const Shard &) = delete;
+    Shard &operator=(const Shard &) = delete;
+
+    void Increment(std::size_t counter) {
+      auto &cell = CounterCell(counter);
+      cell.store(cell.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    void Record(std::size_t histogram, std::uint64_t ns) {
+      auto &cells = HistogramCell(histogram);
+      auto &bucket = cells.buckets[BucketOf(ns)];
+      bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      cells.sum.store(cells.sum.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+      cells.count.store(cells.count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    bool Sample(unsigned interval) {
+      if (++ticks_ < interval)
+        return false;
+      ticks_ = 0;
+      return true;
+    }
+
+   private:
+    friend class StatisticsRegistry;
+
+    struct Counter : std::atomic<std::uint64_t> {
+      Counter() : std::atomic<std::uint64_t>(0) {}
+    };
+
+    struct HistogramCells {
+      Counter buckets[kBuckets];
+      Counter sum;
+      Counter count;
+    };
+
+    Counter &CounterCell(std::size_t id) {
+      if (id >= counters_.size()) {
+        std::lock_guard<std::mutex> lock(registry_.mutex_);
+        while (id >= counters_.size())
+          counters_.emplace_back();
+      }
+      return counters_[id];
+    }
+
+    HistogramCells &HistogramCell(std::size_t id) {
+      if (id >= histograms_.size()) {
+        std::lock_guard<std::mutex> lock(registry_.mutex_);
+        while (id >= histograms_.size())
+          histograms_.emplace_back();
+      }
+      return histograms_[id];
+    }
+
+    // Called with the registry's mutex held.
+    void MergeInto(std::vector<std::uint64_t> &counters, std::vector<Histogram> &histograms) const {
+      if (counters.size() < counters_.size())
+        counters.resize(counters_.size());
+      for (std::size_t i = 0; i < counters_.size(); ++i)
+        counters[i] += counters_[i].load(std::memory_order_relaxed);
+
+      if (histograms.size() < histograms_.size())
+        histograms.resize(histograms_.size());
+      for (std::size_t i = 0; i < histograms_.size(); ++i) {
+        for (unsigned b = 0; b < kBuckets; ++b)
+          histograms[i].buckets[b] += histograms_[i].buckets[b].load(std::memory_order_relaxed);
+        histograms[i].sum += histograms_[i].sum.load(std::memory_order_relaxed);
+        histograms[i].count += histograms_[i].count.load(std::memory_order_relaxed);
+      }
+    }
+
+    StatisticsRegistry &registry_;
+    // deques never move their elements, so the owning thread may keep
+    // updating cells while another thread merges under the registry's mutex
+    std::deque<Counter> counters_;
+    std::deque<HistogramCells> histograms_;
+    unsigned ticks_ = 0;
+  };
+
+  static StatisticsRegistry &Instance() {
+    static StatisticsRegistry registry;
+    return registry;
+  }
+
+  static Shard &LocalShard() {
+    static thread_local Shard shard(Instance());
+    return shard;
+  }
+
+  // Series are identified by name and labels, so adding an existing series
+  // returns its id again.
+  std::size_t AddCounter(const std::string &name, const std::string &labels) {
+    return Add(counter_series_, counter_ids_, name, labels);
+  }
+
+  std::size_t AddHistogram(const std::string &name, const std::string &labels) {
+    return Add(histogram_series_, histogram_ids_, name, labels);
+  }
+
+  /**
+   * Write all series in the Prometheus text exposition format.
+   */
+  void Dump(std::ostream &out) {
+    std::vector<Series> counter_series, histogram_series;
+    std::vector<std::uint64_t> counters;
+    std::vector<Histogram> histograms;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      counter_series = counter_series_;
+      histogram_series = histogram_series_;
+      counters = retired_counters_;
+      histograms = retired_histograms_;
+      for (auto shard : shards_)
+        shard->MergeInto(counters, histograms);
+    }
+    counters.resize(counter_series.size());
+    histograms.resize(histogram_series.size());
+
+    std::map<std::string, std::vector<std::size_t>> by_name;
+    for (std::size_t i = 0; i < counter_series.size(); ++i)
+      by_name[counter_series[i].name].push_back(i);
+    for (auto &metric : by_name) {
+      out << "# TYPE " << metric.first << " counter\n";
+      for (auto i : metric.second)
+        out << metric.first << '{' << counter_series[i].labels << "} " << counters[i] << '\n';
+    }
+
+    by_name.clear();
+    for (std::size_t i = 0; i < histogram_series.size(); ++i)
+      by_name[histogram_series[i].name].push_back(i);
+    for (auto &metric : by_name) {
+      out << "# TYPE " << metric.first << " histogram\n";
+      for (auto i : metric.second) {
+        auto &labels = histogram_series[i].labels;
+        auto &histogram = histograms[i];
+        std::uint64_t cumulative = 0;
+        for (unsigned b = 0; b + 1 < kBuckets; ++b) {
+          cumulative += histogram.buckets[b];
+          // only emit power-of-two boundaries to keep the exposition small
+          if (b >= kSubBuckets && (b + 1) % kSubBuckets != 0)
+            continue;
+          // durations are whole nanoseconds, so the bucket's inclusive
+          // upper bound is one below its exclusive one
+          out << metric.first << "_bucket{" << labels << ",le=\""
+              << static_cast<double>(UpperBoundOf(b) - 1) * 1e-9 << "\"} " << cumulative << '\n';
+        }
+        out << metric.first << "_bucket{" << labels << ",le=\"+Inf\"} " << histogram.count << '\n';
+        out << metric.first << "_sum{" << labels << "} " << static_cast<double>(histogram.sum) * 1e-9 << '\n';
+        out << metric.first << "_count{" << labels << "} " << histogram.count << '\n';
+      }
+    }
+  }
+
+  static std::string Label(const char *name, const std::string &value) {
+    std::string label = name;
+    label += "=\"";
+    for (auto c : value) {
+      if (c == '\\' || c == '"')
+        label += '\\';
+      if (c == '\n') {
+        label += "\\n";
+        continue;
+      }
+      label += c;
+    }
+    label += '"';
+    return label;
+  }
+
+ private:
+  struct Series {
+    std::string name;
+    std::string labels;
+  };
+
+  using SeriesIds = std::map<std::pair<std::string, std::string>, std::size_t>;
+
+  StatisticsRegistry() = default;
+
+  std::size_t Add(std::vector<Series> &series, SeriesIds &ids, const std::string &name, const std::string &labels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = ids.find(std::make_pair(name, labels));
+    if (it != ids.end())
+      return it->second;
+    series.push_back(Series{name, labels});
+    ids.emplace(std::make_pair(name, labels), series.size() - 1);
+    return series.size() - 1;
+  }
+
+  std::mutex mutex_;
+  std::vector<Series> counter_series_;
+  std::vector<Series> histogram_series_;
+  SeriesIds counter_ids_;
+  SeriesIds histogram_ids_;
+  std::vector<Shard *> shards_;
+  std::vector<std::uint64_t> retired_counters_;
+  std::vector<Histogram> retired_histograms_;
+};
+}
+
+/**
+ * Statistics policy recording per-row hit counters, per-state entry counters,
+ * `NoTransition` counters and sampled action latency histograms.
+ *
+ * Pass it as the `Statistics` template argument of `FSM`.
+ *
+ * @tparam sampling_interval time one action out of every `sampling_interval`
+ *         per thread; `0` disables latency sampling
+ */
+template<unsigned sampling_interval = 64>
+class Statistics {
+ public:
+  template<class Row, unsigned index, class Derived, class Event, class State>
+  static void Transition(Derived &self, const Event &event, State from) {
+    static const RowSeries series = RowSeries::template Make<Row, index, Derived, Event>();
+
+    auto &shard = detail::StatisticsRegistry::LocalShard();
+    shard.Increment(series.transitions);
+    if (!(from == Row::TargetValue())) // self-loops do not enter a state
+      shard.Increment(series.entries);
+
+    if (sampling_interval == 0 || !shard.Sample(sampling_interval)) {
+      Row::ProcessEvent(self, event);
+      return;
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    Row::ProcessEvent(self, event);
+    auto elapsed = std::chrono::steady_clock::now() - begin;
+    shard.Record(series.latency,
+                 static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+  }
+
+  template<class Derived, class Event, class State>
+  static void NoTransition(State state) {
+    static thread_local std::unordered_map<long long, std::size_t> ids;
+
+    auto key = static_cast<long long>(state);
+    auto it = ids.find(key);
+    if (it == ids.end()) {
+      auto labels = MachineLabel<Derived>() + ','
+          + detail::StatisticsRegistry::Label("state", std::to_string(key)) + ','
+          + detail::StatisticsRegistry::Label("event", detail::TypeName(typeid(Event)));
+      it = ids.emplace(key, Series(false, "fsm_no_transition_total", labels)).first;
+    }
+    detail::StatisticsRegistry::LocalShard().Increment(it->second);
+  }
+
+  /**
+   * Dump the statistics of every FSM type in the Prometheus text format.
+   */
+  static void Dump(std::ostream &out) {
+    detail::StatisticsRegistry::Instance().Dump(out);
+  }
+
+  static std::string Dump() {
+    std::ostringstream out;
+    Dump(out);
+    return out.str();
+  }
+
+ private:
+  template<class Derived>
+  static const std::string &MachineLabel() {
+    static const std::string label =
+        detail::StatisticsRegistry::Label("machine", detail::TypeName(typeid(Derived)));
+    return label;
+  }
+
+  static std::size_t Series(bool histogram, const std::string &name, const std::string &labels) {
+    auto &registry = detail::StatisticsRegistry::Instance();
+    return histogram ? registry.AddHistogram(name, labels) : registry.AddCounter(name, labels);
+  }
+
+  // rows starting from a set of states are labelled `from="*"`
+  template<class Row>
+  static std::string StartLabel(detail::TrueType) { return std::to_string(static_cast<long long>(Row::StartValue())); }
+
+  template<class Row>
+  static std::string StartLabel(detail::FalseType) { return "*"; }
+
+  struct RowSeries {
+    std::size_t transitions;
+    std::size_t entries;
+    std::size_t latency;
+
+    template<class Row, unsigned index, class Derived, class Event>
+    static RowSeries Make() {
+      auto row = MachineLabel<Derived>() + ',' + detail::StatisticsRegistry::Label("row", std::to_string(index));
+      auto from = StartLabel<Row>(detail::IntegralConstant<bool, Row::StartRank::value == 0>{});
+      auto to = std::to_string(static_cast<long long>(Row::TargetValue()));
+      return RowSeries{
+          Series(false, "fsm_transitions_total", row + ','
+              + detail::StatisticsRegistry::Label("from", from) + ','
+              + detail::StatisticsRegistry::Label("to", to)),
+          Series(false, "fsm_state_entries_total", MachineLabel<Derived>() + ','
+              + detail::StatisticsRegistry::Label("state", to)),
+          Series(true, "fsm_action_duration_seconds", row)
+      };
+    }
+  };
+};
+}
+
+#endif //FSM_INCLUDE_FSM_STATISTICS_H_
@@ -0,0 +1,44 @@
+// Copyright 2020 方泓睿
+//
+// 	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// 	documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef FSM_INCLUDE_FSM_TYPE_NAME_H_
+#define FSM_INCLUDE_FSM_TYPE_NAME_H_
+
+#include <cstdlib> // for std::free
+#include <string>
+#include <typeinfo>
+
+#if __has_include(<cxxabi.h>)
+#include <cxxabi.h>
+#define FSM_HAS_CXXABI 1
+#endif
+
+namespace fsm {
+namespace detail {
+/**
+ * Human readable name of a type, demangled where the ABI allows it.
+ */
+inline std::string TypeName(const std::type_info &type) {
+#if defined(FSM_HAS_CXXABI)
+  int status = 0;
+  char *demangled = abi::__cxa_demangle(type.name(), nullptr, nullptr, &status);
+  if (status == 0 && demangled != nullptr) {
+    std::string name = demangled;
+    std::free(demangled);
+    return name;
+  }
+#endif
+  return type.name();
+}
+}
+}
+
+#endif //FSM_INCLUDE_FSM_TYPE_NAME_H_
@@ -0,0 +1,18 @@
+//
+// Created by fanghr on 2020/5/22.
+//
+
+#ifndef FSM_TESTS_FSM_TEST_CD_PLAYER_EVENTS_H_
+#define FSM_TESTS_FSM_TEST_CD_PLAYER_EVENTS_H_
+
+#include <string>
+
+namespace fsmc_test {
+struct Play {};
+struct OpenClose {};
+struct CDDetected { std::string title; };
+struct Stop {};
+struct Pause {};
+}
+
+#endif //FSM_TESTS_FSM_TEST_CD_PLAYER_EVENTS_H_
@@ -0,0 +1,146 @@
+//
+// Created by fanghr on 2020/5/12.
+//
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <fsm/atomic_state.h>
+
+#include "fsm_test.h"
+
+namespace {
+enum State { kInit, kRunning, kExit };
+
+struct Start {};
+struct Tick {};
+struct Stop {};
+
+template<template<class> class Storage>
+class StateMachine : public fsm::FSM<StateMachine<Storage>, State, bool, fsm::detail::DefaultRWMutex, Storage<State>> {
+  using Base = fsm::FSM<StateMachine<Storage>, State, bool, fsm::detail::DefaultRWMutex, Storage<State>>;
+  friend Base;
+
+ public:
+  StateMachine() : Base(kInit) {}
+
+ private:
+  using TransitionTable = typename Base::template Table<
+      typename Base::template BasicRow<kInit, Start, kRunning>,
+      typename Base::template BasicRow<kRunning, Tick, kRunning>,
+      typename Base::template BasicRow<kRunning, Stop, kExit>>;
+};
+
+struct Wide {
+  unsigned long long a, b, c;
+  bool operator==(const Wide &rhs) const { return a == rhs.a && b == rhs.b && c == rhs.c; }
+};
+
+// fits in a word, but no lock-free atomic has an odd size
+struct Odd {
+  char bytes[3];
+  bool operator==(const Odd &rhs) const { return std::memcmp(bytes, rhs.bytes, sizeof(bytes)) == 0; }
+};
+
+static_assert(std::is_same<fsm::PublishedState<State>, fsm::AtomicState<State>>::value, "");
+static_assert(std::is_same<fsm::PublishedState<Wide>, fsm::SeqlockState<Wide>>::value, "");
+static_assert(std::is_same<fsm::PublishedState<Odd>, fsm::SeqlockState<Odd>>::value, "");
+}
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "cert-err58-cpp"
+
+TEST_F(FSMTestSuite, TestAtomicStateVersion) {
+  StateMachine<fsm::PublishedState> machine{};
+  EXPECT_EQ(machine.CurrentState(), kInit);
+  EXPECT_EQ(machine.StateVersion(), 0u);
+  machine(Start{});
+  EXPECT_EQ(machine.CurrentState(), kRunning);
+  EXPECT_EQ(machine.StateVersion(), 1u);
+  machine(Tick{});
+  EXPECT_EQ(machine.CurrentState(), kRunning);
+  EXPECT_EQ(machine.StateVersion(), 1u);
+  machine(Stop{});
+  EXPECT_EQ(machine.CurrentState(), kExit);
+  EXPECT_EQ(machine.StateVersion(), 2u);
+}
+
+TEST_F(FSMTestSuite, TestSeqlockStateVersion) {
+  StateMachine<fsm::SeqlockState> machine{};
+  EXPECT_EQ(machine.CurrentState(), kInit);
+  machine(Start{});
+  machine(Tick{});
+  EXPECT_EQ(machine.CurrentState(), kRunning);
+  EXPECT_EQ(machine.StateVersion(), 1u);
+  machine(Stop{});
+  EXPECT_EQ(machine.CurrentState(), kExit);
+  EXPECT_EQ(machine.StateVersion(), 2u);
+}
+
+TEST_F(FSMTestSuite, TestPlainStateVersion) {
+  StateMachine<fsm::detail::PlainState> machine{};
+  machine(Start{});
+  machine(Tick{});
+  EXPECT_EQ(machine.StateVersion(), 1u);
+}
+
+TEST_F(FSMTestSuite, TestSeqlockStateConcurrentLoad) {
+  fsm::SeqlockState<Wide> state{Wide{0, 0, 0}};
+  std::atomic<bool> done{false};
+
+  std::thread reader([&] {
+    while (!done.load()) {
+      auto value = state.Load();
+      EXPECT_EQ(value.a, value.b);
+      EXPECT_EQ(value.b, value.c);
+    }
+  });
+
+  for (unsigned long long i = 1; i <= 100000; ++i)
+    state.Store(Wide{i, i, i});
+  done = true;
+  reader.join();
+
+  EXPECT_EQ(state.Load().c, 100000u);
+  EXPECT_EQ(state.Version(), 100000u);
+}
+
+TEST_F(FSMTestSuite, TestWaitForState) {
+  StateMachine<fsm::WaitableState> machine{};
+  EXPECT_TRUE(machine.WaitForState(kInit, std::chrono::milliseconds(0)));
+  EXPECT_FALSE(machine.WaitForState(kExit, std::chrono::milliseconds(10)));
+
+  std::atomic<bool> running{false};
+  std::thread waiter([&] {
+    EXPECT_TRUE(machine.WaitUntil([](State state) { return state != kInit; }, std::chrono::seconds(10)));
+    running = true;
+    EXPECT_TRUE(machine.WaitForState(kExit, std::chrono::seconds(10)));
+  });
+
+  machine(Start{});
+  while (!running.load())
+    std::this_thread::yield();
+  machine(Tick{});
+  machine(Stop{});
+  waiter.join();
+  EXPECT_EQ(machine.StateVersion(), 2u);
+}
+
+TEST_F(FSMTestSuite, TestWaitableStateManyWaiters) {
+  fsm::WaitableState<unsigned> state{0};
+  std::vector<std::thread> waiters;
+  for (unsigned i = 1; i <= 8; ++i)
+    waiters.emplace_back([&state, i] {
+      state.WaitUntil([i](unsigned value) { return value >= i * 1000; });
+    });
+  for (unsigned i = 1; i <= 8000; ++i)
+    state.Store(i);
+  for (auto &waiter : waiters)
+    waiter.join();
+  EXPECT_EQ(state.Version(), 8000u);
+}
+
+#pragma clang diagnostic pop
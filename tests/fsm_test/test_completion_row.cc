@@ -0,0 +1,120 @@
+//
+// Created by fanghr on 2020/5/31.
+//
+
+#include "fsm_test.h"
+
+namespace {
+class Order : public fsm::FSM<Order> {
+  friend class FSM;
+ public:
+  enum States { kIdle, kCheck, kApproved, kReview, kShipped };
+
+  struct Submit { int amount; };
+  struct Reset {};
+
+  int amount = 0;
+  int shipped = 0;
+  int changes = 0;
+  int last_from = -1, last_to = -1;
+
+ private:
+  void Store(const Submit &submit) { amount = submit.amount; }
+  bool IsSmall() const { return amount < 100; }
+  void Ship() { ++shipped; }
+
+  void OnStateChange(StateType from, StateType to) noexcept {
+    ++changes;
+    last_from = from;
+    last_to = to;
+  }
+
+  using TransitionTable = Table<
+      MemFnRow<kIdle, Submit, kCheck, &Order::Store>,
+      CompletionRow<kCheck, kApproved, nullptr, &Order::IsSmall>,
+      CompletionRow<kCheck, kReview>,
+      CompletionRow<kApproved, kShipped, &Order::Ship>,
+      BasicRow<kReview, Reset, kIdle>,
+      BasicRow<kShipped, Reset, kIdle>>;
+};
+
+template<class ErrorPolicy>
+class Loop : public fsm::FSM<Loop<ErrorPolicy>, int, bool, fsm::detail::DefaultRWMutex,
+                             fsm::detail::PlainState<int>, fsm::detail::NoStatistics, ErrorPolicy> {
+  using Base = fsm::FSM<Loop<ErrorPolicy>, int, bool, fsm::detail::DefaultRWMutex,
+                        fsm::detail::PlainState<int>, fsm::detail::NoStatistics, ErrorPolicy>;
+  friend Base;
+ public:
+  struct Start {};
+
+  static constexpr unsigned kMaxCompletionDepth = 5;
+
+  int steps = 0;
+
+ private:
+  void Step() { ++steps; }
+
+  using TransitionTable = typename Base::template Table<
+      typename Base::template BasicRow<0, Start, 1>,
+      typename Base::template CompletionRow<1, 2, &Loop::Step>,
+      typename Base::template CompletionRow<2, 1, &Loop::Step>>;
+};
+}
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "cert-err58-cpp"
+
+TEST_F(FSMTestSuite, TestCompletionRow) {
+  Order order{};
+  EXPECT_EQ(order.Dispatch(Order::Submit{42}), Order::kShipped);
+  EXPECT_EQ(order.shipped, 1);
+  EXPECT_EQ(order.changes, 1);
+  EXPECT_EQ(order.last_from, Order::kIdle);
+  EXPECT_EQ(order.last_to, Order::kShipped);
+
+  EXPECT_EQ(order.Dispatch(Order::Reset{}), Order::kIdle);
+  EXPECT_EQ(order.Dispatch(Order::Submit{1000}), Order::kReview);
+  EXPECT_EQ(order.shipped, 1);
+
+  // guards only see the event's row, completion rows are not followed
+  EXPECT_EQ(order.Dispatch(Order::Reset{}), Order::kIdle);
+  EXPECT_EQ(order.PeekTransition(Order::Submit{1}).target, Order::kCheck);
+
+  static_assert(std::is_same<Order::EventTypes<>, fsm::detail::List<Order::Submit, Order::Reset>>::value,
+                "completion rows have no event type");
+}
+
+TEST_F(FSMTestSuite, TestCompletionRowDepthLimit) {
+  Loop<fsm::ReturnStatusOnError> machine{};
+  auto result = machine.Dispatch(Loop<fsm::ReturnStatusOnError>::Start{});
+  EXPECT_FALSE(static_cast<bool>(result));
+  EXPECT_EQ(result.error, fsm::DispatchError::kCompletionLimit);
+  EXPECT_EQ(machine.steps, 5);
+  EXPECT_EQ(result.state, 2);
+  EXPECT_EQ(machine.CurrentState(), 2);
+
+  Loop<fsm::detail::DefaultErrorPolicy> throwing{};
+  EXPECT_THROW(throwing.Dispatch(Loop<fsm::detail::DefaultErrorPolicy>::Start{}), std::logic_error);
+}
+
+TEST_F(FSMTestSuite, TestCompletionRowDispatchAll) {
+  Order first{}, second{};
+  EXPECT_EQ(fsm::DispatchAll(first, Order::Submit{1}, second, Order::Submit{500}), fsm::TransactionResult::kCommitted);
+  EXPECT_EQ(first.CurrentState(), Order::kShipped);
+  EXPECT_EQ(second.CurrentState(), Order::kReview);
+  EXPECT_EQ(first.shipped, 1);
+}
+
+TEST_F(FSMTestSuite, TestCompletionRowDispatchAllDepthLimit) {
+  using Machine = Loop<fsm::ReturnStatusOnError>;
+  Machine loop{};
+  Order order{};
+  EXPECT_EQ(fsm::DispatchAll(order, Order::Submit{1}, loop, Machine::Start{}),
+            fsm::TransactionResult::kCompletionLimit);
+  // committed nonetheless, like `Dispatch()`
+  EXPECT_EQ(order.CurrentState(), Order::kShipped);
+  EXPECT_EQ(loop.CurrentState(), 2);
+  EXPECT_EQ(loop.steps, 5);
+}
+
+#pragma clang diagnostic pop
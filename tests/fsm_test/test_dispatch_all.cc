@@ -0,0 +1,212 @@
+//
+// Created by fanghr on 2020/5/20.
+//
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "fsm_test.h"
+
+namespace {
+struct Pair {
+  bool accept;
+};
+struct Release {};
+
+class Session : public fsm::FSM<Session> {
+  friend class FSM;
+ public:
+  enum States { kIdle, kPaired };
+
+  int actions = 0;
+
+ private:
+  void Count(const Pair &) { ++actions; }
+  bool Accepts(const Pair &pair) const { return pair.accept; }
+
+  using TransitionTable = Table<
+  MemFnRow<kIdle, Pair, kPaired, &Session::Count, &Session::Accepts>,
+  BasicRow<kPaired, Release, kIdle>>;
+};
+
+class Resource : public fsm::FSM<Resource> {
+  friend class FSM;
+ public:
+  enum States { kFree, kBusy };
+
+  int actions = 0;
+
+ private:
+  void Count(const Pair &) { ++actions; }
+
+  using TransitionTable = Table<
+  MemFnRow<kFree, Pair, kBusy, &Resource::Count>,
+  BasicRow<kBusy, Release, kFree>>;
+};
+
+// Dispatches a transaction including itself from its own action.
+class Relay : public fsm::FSM<Relay> {
+  friend class FSM;
+ public:
+  enum States { kIdle, kRelayed };
+
+  explicit Relay(Resource &peer) : peer_(peer) {}
+
+  fsm::TransactionResult result = fsm::TransactionResult::kCommitted;
+
+ private:
+  void Forward(const Pair &pair) { result = fsm::DispatchAll(*this, Release{}, peer_, pair); }
+
+  using TransitionTable = Table<
+  MemFnRow<kIdle, Pair, kRelayed, &Relay::Forward>,
+  BasicRow<kRelayed, Release, kIdle>>;
+
+  Resource &peer_;
+};
+
+class Mutex : public fsm::detail::RWMutexInterface {
+ public:
+  void Lock() override { mutex_.lock(); }
+  void Unlock() override { mutex_.unlock(); }
+  void RLock() override { mutex_.lock(); }
+  void RUnlock() override { mutex_.unlock(); }
+
+ private:
+  std::mutex mutex_;
+};
+
+struct Flip {};
+
+class Switch : public fsm::FSM<Switch, int, std::atomic<bool>, Mutex> {
+  friend class FSM;
+ public:
+  enum States { kOff, kOn };
+
+  int flips = 0;
+
+ private:
+  void Count(const Flip &) { ++flips; }
+
+  using TransitionTable = Table<
+  MemFnRow<kOff, Flip, kOn, &Switch::Count>,
+  MemFnRow<kOn, Flip, kOff, &Switch::Count>>;
+};
+}
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "cert-err58-cpp"
+
+TEST_F(FSMTestSuite, TestDispatchAll) {
+  Session session;
+  Resource resource;
+
+  using fsm::TransactionResult;
+
+  // a failing guard aborts the whole transaction before any action runs
+  EXPECT_EQ(fsm::DispatchAll(resource, Pair{true}, session, Pair{false}), TransactionResult::kRejected);
+  EXPECT_EQ(resource.CurrentState(), Resource::kFree);
+  EXPECT_EQ(resource.actions, 0);
+  EXPECT_EQ(session.actions, 0);
+
+  EXPECT_EQ(fsm::DispatchAll(session, Pair{true}, resource, Pair{true}), TransactionResult::kCommitted);
+  EXPECT_EQ(session.CurrentState(), Session::kPaired);
+  EXPECT_EQ(resource.CurrentState(), Resource::kBusy);
+  EXPECT_EQ(session.actions, 1);
+  EXPECT_EQ(resource.actions, 1);
+
+  // no row for Pair in kPaired
+  EXPECT_EQ(fsm::DispatchAll(session, Pair{true}, resource, Release{}), TransactionResult::kRejected);
+  EXPECT_EQ(resource.CurrentState(), Resource::kBusy);
+
+  EXPECT_EQ(fsm::DispatchAll(session, Release{}, resource, Release{}), TransactionResult::kCommitted);
+  EXPECT_EQ(session.CurrentState(), Session::kIdle);
+  EXPECT_EQ(resource.CurrentState(), Resource::kFree);
+
+  // the same machine twice is rejected
+  EXPECT_EQ(fsm::DispatchAll(session, Pair{true}, session, Pair{true}), TransactionResult::kRejected);
+  EXPECT_EQ(session.CurrentState(), Session::kIdle);
+  EXPECT_EQ(fsm::DispatchAll(session, Pair{true}), TransactionResult::kCommitted);
+}
+
+TEST_F(FSMTestSuite, TestDispatchAllBusy) {
+  Resource resource;
+  Relay relay{resource};
+
+  // the relay is still dispatching Pair when its action starts the transaction
+  relay.Dispatch(Pair{true});
+  EXPECT_EQ(relay.result, fsm::TransactionResult::kBusy);
+  EXPECT_EQ(relay.CurrentState(), Relay::kRelayed);
+  EXPECT_EQ(resource.CurrentState(), Resource::kFree);
+  EXPECT_EQ(resource.actions, 0);
+
+  // and is free again afterwards
+  EXPECT_EQ(fsm::DispatchAll(relay, Release{}, resource, Pair{true}), fsm::TransactionResult::kCommitted);
+  EXPECT_EQ(resource.CurrentState(), Resource::kBusy);
+}
+
+TEST_F(FSMTestSuite, TestDispatchAllConcurrent) {
+  constexpr int kSwitches = 8;
+  constexpr int kThreads = 4;
+  constexpr int kTransactions = 2000;
+  std::vector<Switch> switches(kSwitches);
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&switches, t] {
+      unsigned seed = static_cast<unsigned>(t) + 1;
+      for (int n = 0; n < kTransactions; ++n) {
+        seed = seed * 1103515245u + 12345u;
+        auto i = (seed >> 16u) % kSwitches, j = (i + 1 + (seed >> 8u) % (kSwitches - 1)) % kSwitches;
+        auto k = (j + 1) % kSwitches == i ? (i + 1) % kSwitches : (j + 1) % kSwitches;
+        // overlapping transactions wait for each other instead of failing
+        EXPECT_EQ(fsm::DispatchAll(switches[i], Flip{}, switches[j], Flip{}, switches[k], Flip{}),
+                  fsm::TransactionResult::kCommitted);
+      }
+    });
+  }
+  for (auto &thread : threads)
+    thread.join();
+
+  int flips = 0;
+  for (auto &machine : switches) {
+    flips += machine.flips;
+    EXPECT_EQ(machine.CurrentState(), machine.flips % 2 ? Switch::kOn : Switch::kOff);
+  }
+  EXPECT_EQ(flips, 3 * kThreads * kTransactions);
+}
+
+TEST_F(FSMTestSuite, TestDispatchAllWithDispatch) {
+  constexpr int kSwitches = 4;
+  constexpr int kRounds = 2000;
+  std::vector<Switch> switches(kSwitches);
+
+  // plain dispatches from other threads wait for transactions over the same
+  // machines, and for each other, instead of failing as recursive
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 2; ++t) {
+    threads.emplace_back([&switches, t] {
+      for (int n = 0; n < kRounds; ++n) {
+        auto i = (n + t) % kSwitches;
+        EXPECT_EQ(fsm::DispatchAll(switches[i], Flip{}, switches[(i + 1) % kSwitches], Flip{}),
+                  fsm::TransactionResult::kCommitted);
+      }
+    });
+    threads.emplace_back([&switches, t] {
+      for (int n = 0; n < kRounds; ++n)
+        switches[(n + t) % kSwitches].Dispatch(Flip{});
+    });
+  }
+  for (auto &thread : threads)
+    thread.join();
+
+  int flips = 0;
+  for (auto &machine : switches) {
+    flips += machine.flips;
+    EXPECT_EQ(machine.CurrentState(), machine.flips % 2 ? Switch::kOn : Switch::kOff);
+  }
+  EXPECT_EQ(flips, 2 * 2 * kRounds + 2 * kRounds);
+}
+
+#pragma clang diagnostic pop
@@ -0,0 +1,100 @@
+//
+// Created by fanghr on 2020/5/15.
+//
+
+#include "fsm_test.h"
+
+namespace {
+enum State { kInit, kExit };
+
+template<class ErrorPolicy>
+class RecursiveMachine : public fsm::FSM<RecursiveMachine<ErrorPolicy>, State, bool, fsm::detail::DefaultRWMutex,
+                                         fsm::detail::PlainState<State>, fsm::detail::NoStatistics, ErrorPolicy> {
+  using Base = fsm::FSM<RecursiveMachine<ErrorPolicy>, State, bool, fsm::detail::DefaultRWMutex,
+                        fsm::detail::PlainState<State>, fsm::detail::NoStatistics, ErrorPolicy>;
+  friend Base;
+ public:
+  using Event = int;
+
+  typename Base::DispatchResultType inner{};
+
+  void DispatchEvent(const Event &event) {
+    inner = this->Dispatch(event + 1);
+  }
+
+ private:
+  using TransitionTable = typename Base::template Table<
+      typename Base::template MemFnRow<kInit, Event, kExit, &RecursiveMachine::DispatchEvent>>;
+};
+
+template<class ErrorPolicy>
+class PlainMachine : public fsm::FSM<PlainMachine<ErrorPolicy>, State, bool, fsm::detail::DefaultRWMutex,
+                                     fsm::detail::PlainState<State>, fsm::detail::NoStatistics, ErrorPolicy> {
+  using Base = fsm::FSM<PlainMachine<ErrorPolicy>, State, bool, fsm::detail::DefaultRWMutex,
+                        fsm::detail::PlainState<State>, fsm::detail::NoStatistics, ErrorPolicy>;
+  friend Base;
+ public:
+  struct Event {};
+
+ private:
+  using TransitionTable = typename Base::template Table<typename Base::template BasicRow<kInit, Event, kExit>>;
+};
+
+int errors = 0;
+
+void CountError(fsm::DispatchError error) {
+  if (error == fsm::DispatchError::kRecursiveDispatch)
+    ++errors;
+}
+}
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "cert-err58-cpp"
+
+TEST_F(FSMTestSuite, TestReturnStatusOnError) {
+  RecursiveMachine<fsm::ReturnStatusOnError> machine{};
+  auto result = machine(1);
+  EXPECT_TRUE(static_cast<bool>(result));
+  EXPECT_EQ(result.state, kExit);
+  EXPECT_FALSE(static_cast<bool>(machine.inner));
+  EXPECT_EQ(machine.inner.error, fsm::DispatchError::kRecursiveDispatch);
+  EXPECT_EQ(machine.inner.state, kInit);
+}
+
+TEST_F(FSMTestSuite, TestCallHandlerOnError) {
+  RecursiveMachine<fsm::CallHandlerOnError<&CountError>> machine{};
+  EXPECT_EQ(machine(1), kExit);
+  EXPECT_EQ(machine.inner, kInit);
+  EXPECT_EQ(errors, 1);
+}
+
+TEST_F(FSMTestSuite, TestAssertOnError) {
+  RecursiveMachine<fsm::AssertOnError> machine{};
+  EXPECT_DEBUG_DEATH(machine(1), "");
+}
+
+TEST_F(FSMTestSuite, TestNothrowDispatch) {
+  PlainMachine<fsm::ReturnStatusOnError> status{};
+  PlainMachine<fsm::AssertOnError> asserting{};
+  PlainMachine<fsm::detail::DefaultErrorPolicy> throwing{};
+  RecursiveMachine<fsm::ReturnStatusOnError> recursive{};
+
+  EXPECT_TRUE(noexcept(status.Dispatch(PlainMachine<fsm::ReturnStatusOnError>::Event{})));
+  EXPECT_TRUE(noexcept(asserting(PlainMachine<fsm::AssertOnError>::Event{})));
+#if defined(__cpp_exceptions)
+  EXPECT_FALSE(noexcept(throwing.Dispatch(PlainMachine<fsm::detail::DefaultErrorPolicy>::Event{})));
+#endif
+  // the row's action is a member function, which is never known not to throw
+  EXPECT_FALSE(noexcept(recursive.Dispatch(1)));
+
+  EXPECT_EQ(status.Dispatch(PlainMachine<fsm::ReturnStatusOnError>::Event{}).state, kExit);
+}
+
+// a table without guards and actions dispatches without any throwing step
+static_assert(noexcept(fsm::detail::DeclVal<PlainMachine<fsm::ReturnStatusOnError> &>()
+                           .Dispatch(PlainMachine<fsm::ReturnStatusOnError>::Event{})),
+              "a table of plain rows should dispatch noexcept");
+static_assert(!noexcept(fsm::detail::DeclVal<RecursiveMachine<fsm::ReturnStatusOnError> &>().Dispatch(1)),
+              "a member function action may throw");
+
+#pragma clang diagnostic pop
@@ -0,0 +1,214 @@
+//
+// Created by fanghr on 2020/5/20.
+//
+
+#if defined(__linux__)
+
+#include <string>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <fsm/event_loop.h>
+
+#include "fsm_test.h"
+
+namespace {
+template<class Loop>
+class Connection : public fsm::FSM<Connection<Loop>> {
+  using Base = fsm::FSM<Connection<Loop>>;
+  friend Base;
+
+ public:
+  enum States { kOpen, kClosed };
+
+  explicit Connection(Loop &loop) : loop_(loop) {}
+
+  std::string received;
+  int writable = 0;
+
+ private:
+  void Read(const fsm::Readable &event) {
+    char buffer[64];
+    auto n = read(event.fd, buffer, sizeof(buffer));
+    if (n > 0)
+      received.append(buffer, static_cast<std::size_t>(n));
+  }
+
+  void CountWritable(const fsm::Writable &event) {
+    ++writable;
+    loop_.Remove(event.fd);
+  }
+
+  void Close(const fsm::Hangup &event) { loop_.Remove(event.fd); }
+
+  using TransitionTable = typename Base::template Table<
+      typename Base::template MemFnRow<kOpen, fsm::Readable, kOpen, &Connection::Read>,
+      typename Base::template MemFnRow<kOpen, fsm::Writable, kOpen, &Connection::CountWritable>,
+      typename Base::template MemFnRow<kOpen, fsm::Hangup, kClosed, &Connection::Close>>;
+
+  Loop &loop_;
+};
+
+template<class Loop>
+class EventLoopTest : public FSMTestSuite {};
+
+using Loops = ::testing::Types<fsm::EpollEventLoop, fsm::IoUringEventLoop>;
+TYPED_TEST_SUITE(EventLoopTest, Loops);
+}
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "cert-err58-cpp"
+
+TYPED_TEST(EventLoopTest, TestSocketPair) {
+  int fds[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+  TypeParam loop;
+  Connection<TypeParam> connection{loop};
+  loop.Add(fds[0], connection, TypeParam::kReadable);
+  EXPECT_EQ(loop.RunOnce(0), 0u);
+
+  ASSERT_EQ(write(fds[1], "hello", 5), 5);
+  EXPECT_EQ(loop.RunOnce(1000), 1u);
+  EXPECT_EQ(connection.received, "hello");
+
+  // the poll is re-armed after each notification
+  ASSERT_EQ(write(fds[1], " world", 6), 6);
+  EXPECT_EQ(loop.RunOnce(1000), 1u);
+  EXPECT_EQ(connection.received, "hello world");
+
+  close(fds[1]);
+  while (connection.CurrentState() != Connection<TypeParam>::kClosed)
+    ASSERT_GT(loop.RunOnce(1000), 0u);
+  EXPECT_EQ(loop.RunOnce(0), 0u);
+  close(fds[0]);
+}
+
+TYPED_TEST(EventLoopTest, TestDuplicateFd) {
+  int fds[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+  TypeParam loop;
+  Connection<TypeParam> first{loop}, second{loop};
+  loop.Add(fds[0], first, TypeParam::kReadable);
+  try {
+    loop.Add(fds[0], second, TypeParam::kReadable);
+    ADD_FAILURE() << "a watched fd was added twice";
+  } catch (const std::system_error &e) {
+    EXPECT_EQ(e.code().value(), EEXIST);
+  }
+
+  // the first registration is untouched
+  ASSERT_EQ(write(fds[1], "x", 1), 1);
+  EXPECT_EQ(loop.RunOnce(1000), 1u);
+  EXPECT_EQ(first.received, "x");
+  EXPECT_EQ(second.received, "");
+
+  loop.Remove(fds[0]);
+  loop.Add(fds[0], second, TypeParam::kReadable);
+  ASSERT_EQ(write(fds[1], "y", 1), 1);
+  EXPECT_EQ(loop.RunOnce(1000), 1u);
+  EXPECT_EQ(second.received, "y");
+
+  loop.Remove(fds[0]);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+TYPED_TEST(EventLoopTest, TestRejectedFd) {
+  // only epoll rejects an fd when it is added; io_uring reports it as a hangup
+  if (!std::is_same<TypeParam, fsm::EpollEventLoop>::value)
+    return;
+
+  auto fd = open("/dev/null", O_RDONLY);
+  ASSERT_GE(fd, 0);
+  TypeParam loop;
+  Connection<TypeParam> connection{loop};
+  for (int i = 0; i < 2; ++i) {
+    // a failed registration leaves nothing behind, so the retry fails the same way
+    try {
+      loop.Add(fd, connection, TypeParam::kReadable);
+      ADD_FAILURE() << "epoll accepted /dev/null";
+    } catch (const std::system_error &e) {
+      EXPECT_EQ(e.code().value(), EPERM);
+    }
+  }
+  loop.Remove(fd);
+  EXPECT_EQ(loop.RunOnce(0), 0u);
+  close(fd);
+}
+
+TYPED_TEST(EventLoopTest, TestBatch) {
+  constexpr int kPipes = 32;
+  int fds[kPipes][2];
+
+  TypeParam loop;
+  std::vector<std::unique_ptr<Connection<TypeParam>>> connections;
+  for (auto &fd : fds) {
+    ASSERT_EQ(pipe(fd), 0);
+    connections.emplace_back(new Connection<TypeParam>(loop));
+    loop.Add(fd[0], *connections.back(), TypeParam::kReadable);
+    loop.Add(fd[1], *connections.back(), TypeParam::kWritable);
+  }
+
+  // every write end is writable once, then removes itself
+  std::size_t dispatched = 0;
+  while (dispatched < kPipes)
+    dispatched += loop.RunOnce(1000);
+  EXPECT_EQ(dispatched, static_cast<std::size_t>(kPipes));
+
+  for (auto &fd : fds)
+    ASSERT_EQ(write(fd[1], "x", 1), 1);
+  dispatched = 0;
+  while (dispatched < kPipes)
+    dispatched += loop.RunOnce(1000);
+  for (auto &connection : connections) {
+    EXPECT_EQ(connection->received, "x");
+    EXPECT_EQ(connection->writable, 1);
+  }
+
+  for (auto &fd : fds) {
+    loop.Remove(fd[0]);
+    close(fd[0]);
+    close(fd[1]);
+  }
+  EXPECT_EQ(loop.RunOnce(0), 0u);
+}
+
+TYPED_TEST(EventLoopTest, TestBatchSize) {
+  constexpr int kPipes = 16;
+  int fds[kPipes][2];
+
+  // more registrations than submission queue entries, and more ready fds than a batch
+  TypeParam loop{4};
+  std::vector<std::unique_ptr<Connection<TypeParam>>> connections;
+  for (auto &fd : fds) {
+    ASSERT_EQ(pipe(fd), 0);
+    ASSERT_EQ(write(fd[1], "x", 1), 1);
+    connections.emplace_back(new Connection<TypeParam>(loop));
+    loop.Add(fd[0], *connections.back(), TypeParam::kReadable);
+  }
+
+  std::size_t dispatched = 0;
+  while (dispatched < kPipes) {
+    auto n = loop.RunOnce(1000);
+    ASSERT_GT(n, 0u);
+    EXPECT_LE(n, 4u);
+    dispatched += n;
+  }
+  for (auto &connection : connections)
+    EXPECT_EQ(connection->received, "x");
+
+  for (auto &fd : fds) {
+    loop.Remove(fd[0]);
+    close(fd[0]);
+    close(fd[1]);
+  }
+}
+
+#pragma clang diagnostic pop
+
+#endif
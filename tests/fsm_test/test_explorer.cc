@@ -0,0 +1,112 @@
+//
+// Created by fanghr on 2020/5/14.
+//
+
+#include <string>
+
+#include <fsm/explorer.h>
+
+#include "fsm_test.h"
+
+namespace {
+// A trimmed down cd player with a deliberately broken row.
+class Player : public fsm::FSM<Player> {
+  friend class FSM;
+ public:
+  enum States { kStopped, kOpen, kEmpty, kPlaying };
+
+  struct Play {};
+  struct OpenClose {};
+  struct CDDetected { std::string title; };
+
+  explicit Player(bool broken) : FSM(kEmpty), broken_(broken) {}
+
+  const std::string &Title() const { return title_; }
+
+  bool operator==(const Player &rhs) const {
+    return CurrentState() == rhs.CurrentState() && title_ == rhs.title_ && broken_ == rhs.broken_;
+  }
+
+ private:
+  bool IsBroken(const Play &) const { return broken_; }
+
+  void Store(const CDDetected &cd) { title_ = cd.title; }
+  void Eject(const OpenClose &) { title_.clear(); }
+
+  using TransitionTable = Table<
+  MemFnRow<kEmpty, CDDetected, kStopped, &Player::Store>,
+  MemFnRow<kEmpty, Play, kPlaying, nullptr, &Player::IsBroken>,
+  MemFnRow<kEmpty, OpenClose, kOpen>,
+  MemFnRow<kOpen, OpenClose, kEmpty>,
+  MemFnRow<kStopped, Play, kPlaying>,
+  MemFnRow<kStopped, OpenClose, kOpen, &Player::Eject>,
+  MemFnRow<kPlaying, OpenClose, kOpen, &Player::Eject>>;
+
+  std::string title_;
+  bool broken_;
+};
+
+struct PlayerHash {
+  std::size_t operator()(const Player &player) const {
+    return std::hash<std::string>{}(player.Title()) * 31 + static_cast<std::size_t>(player.CurrentState());
+  }
+};
+
+bool NeverPlaysWithoutTitle(const Player &player) {
+  return player.CurrentState() != Player::kPlaying || !player.Title().empty();
+}
+}
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "cert-err58-cpp"
+
+TEST_F(FSMTestSuite, TestExplorerHolds) {
+  fsm::Explorer<Player, PlayerHash> explorer{Player{false}};
+  explorer.AddEvent(Player::OpenClose{}, "OpenClose")
+      .AddEvent(Player::Play{}, "Play")
+      .AddEvent(Player::CDDetected{"#a"}, "CDDetected#a")
+      .AddEvent(Player::CDDetected{"#b"}, "CDDetected#b")
+      .AddInvariant("NeverPlaysWithoutTitle", NeverPlaysWithoutTitle);
+
+  auto result = explorer.Run(4);
+  EXPECT_TRUE(result.complete);
+  EXPECT_TRUE(result.violations.empty());
+  // kEmpty and kOpen without title, kStopped and kPlaying with either title
+  EXPECT_EQ(result.states, 2u + 2u * 2u);
+}
+
+TEST_F(FSMTestSuite, TestExplorerCounterexample) {
+  fsm::Explorer<Player, PlayerHash> explorer{Player{true}};
+  explorer.AddEvent(Player::OpenClose{}, "OpenClose")
+      .AddEvent(Player::Play{}, "Play")
+      .AddInvariant("NeverPlaysWithoutTitle", NeverPlaysWithoutTitle);
+
+  auto result = explorer.Run(2);
+  EXPECT_FALSE(result.complete);
+  ASSERT_EQ(result.violations.size(), 1u);
+  EXPECT_EQ(result.violations[0].invariant, "NeverPlaysWithoutTitle");
+  ASSERT_EQ(result.violations[0].trace.size(), 1u);
+  EXPECT_EQ(result.violations[0].trace[0], "Play");
+}
+
+TEST_F(FSMTestSuite, TestExplorerTableEvents) {
+  // a default constructed CDDetected has an empty title
+  fsm::Explorer<Player, PlayerHash> explorer{Player{false}};
+  explorer.AddTableEvents().AddInvariant("NeverPlaysWithoutTitle", NeverPlaysWithoutTitle);
+
+  auto result = explorer.Run();
+  ASSERT_EQ(result.violations.size(), 1u);
+  ASSERT_EQ(result.violations[0].trace.size(), 2u);
+  EXPECT_EQ(result.violations[0].trace[0], "(anonymous namespace)::Player::CDDetected");
+  EXPECT_EQ(result.violations[0].trace[1], "(anonymous namespace)::Player::Play");
+}
+
+TEST_F(FSMTestSuite, TestExplorerMaxStates) {
+  fsm::Explorer<Player, PlayerHash> explorer{Player{false}};
+  explorer.AddTableEvents();
+  auto result = explorer.Run(1, 2);
+  EXPECT_FALSE(result.complete);
+  EXPECT_EQ(result.states, 2u);
+}
+
+#pragma clang diagnostic pop
@@ -0,0 +1,108 @@
+//
+// Created by fanghr on 2020/5/22.
+//
+
+#include <string>
+
+#include "fsm_test.h"
+#include "cd_player.fsm.h" // generated by fsmc from cd_player.fsm
+#include "cd_player_table.fsm.h" // generated by fsmc --table from cd_player_table.fsm
+
+namespace {
+using namespace fsmc_test;
+
+// The same player on top of either generated base.
+template<template<class, class...> class Generated>
+class Machine : public Generated<Machine<Generated>> {
+  friend fsm::FSM<Machine, typename Generated<Machine>::States>;
+  friend Generated<Machine>;
+
+ public:
+  using typename Generated<Machine>::StateType;
+
+  explicit Machine(StateType init_state = StateType::kEmpty) : Generated<Machine>(init_state) {}
+
+  bool autoplay = false;
+  std::string title;
+  int actions = 0;
+  int no_transitions = 0;
+
+ private:
+  bool IsAutoplay(const CDDetected &) const { return autoplay; }
+  bool IsBadCD(const CDDetected &cd) const { return cd.title.empty() || cd.title[0] != '#'; }
+
+  void StartPlayback(const Play &) { ++actions; }
+  void StartAutoplay(const CDDetected &cd) { title = cd.title, ++actions; }
+  void OpenDrawer(const CDDetected &) { ++actions; }
+  void OpenDrawer(const OpenClose &) { title.clear(), ++actions; }
+  void CloseDrawer(const OpenClose &) { ++actions; }
+  void StoreCDInfo(const CDDetected &cd) { title = cd.title, ++actions; }
+  void StopPlayback(const Stop &) { ++actions; }
+  void PausePlayback(const Pause &) { ++actions; }
+  void StopAndOpen(const OpenClose &) { title.clear(), ++actions; }
+  void ResumePlayback(const Play &) { ++actions; }
+
+  template<class Event>
+  StateType NoTransition(const Event &) {
+    ++no_transitions;
+    return this->CurrentState();
+  }
+};
+
+using Player = Machine<PlayerBase>;
+using TablePlayer = Machine<TablePlayerBase>;
+
+// without --table no row template is instantiated
+static_assert(fsm::detail::IsSame<Player::TransitionTable, fsm::detail::List<>>::value, "");
+static_assert(fsm::detail::Size<TablePlayer::TransitionTable>::value == 13, "");
+
+template<class Event>
+void ExpectSameAsTable(PlayerState state, const Event &event) {
+  Player player{state};
+  TablePlayer table_player{static_cast<TablePlayerState>(state)};
+  auto peek = table_player.PeekTransition(event);
+  player.Dispatch(event);
+  EXPECT_EQ(static_cast<int>(player.CurrentState()), static_cast<int>(peek.target)) << static_cast<int>(state);
+  EXPECT_EQ(player.actions, peek.matched ? 1 : 0) << static_cast<int>(state);
+  EXPECT_EQ(player.no_transitions, peek.matched ? 0 : 1) << static_cast<int>(state);
+}
+}
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "cert-err58-cpp"
+
+TEST_F(FSMTestSuite, TestFsmcGeneratedDispatch) {
+  Player player{};
+  player(OpenClose{});
+  EXPECT_EQ(player.CurrentState(), PlayerState::kOpen);
+  player(OpenClose{});
+  EXPECT_EQ(player.CurrentState(), PlayerState::kEmpty);
+  player(CDDetected{"bad"});
+  EXPECT_EQ(player.CurrentState(), PlayerState::kOpen);
+  player(OpenClose{});
+  player(CDDetected{"#good"});
+  EXPECT_EQ(player.CurrentState(), PlayerState::kStopped);
+  EXPECT_EQ(player.title, "#good");
+  player(Play{});
+  player(Pause{});
+  EXPECT_EQ(player.CurrentState(), PlayerState::kPaused);
+  player(Stop{});
+  EXPECT_EQ(player.CurrentState(), PlayerState::kStopped);
+  player(Stop{});
+  EXPECT_EQ(player.no_transitions, 1);
+  EXPECT_EQ(player.actions, 8);
+}
+
+TEST_F(FSMTestSuite, TestFsmcMatchesTransitionTable) {
+  for (auto state : {PlayerState::kStopped, PlayerState::kOpen, PlayerState::kEmpty, PlayerState::kPlaying,
+                     PlayerState::kPaused}) {
+    ExpectSameAsTable(state, Play{});
+    ExpectSameAsTable(state, OpenClose{});
+    ExpectSameAsTable(state, CDDetected{"#cd"});
+    ExpectSameAsTable(state, CDDetected{"bad"});
+    ExpectSameAsTable(state, Stop{});
+    ExpectSameAsTable(state, Pause{});
+  }
+}
+
+#pragma clang diagnostic pop
@@ -0,0 +1,143 @@
+//
+// Created by fanghr on 2020/6/1.
+//
+
+#include "fsm_test.h"
+
+namespace {
+enum Stage { kIdle, kLeft1, kRight1, kLeft2, kRight2, kDone, kUnused };
+
+struct Go {};
+struct Alt {};
+struct Next {};
+struct Cancel {};
+struct Reset {};
+
+template<bool minimize>
+class Pipeline : public fsm::FSM<Pipeline<minimize>, Stage> {
+  using Base = fsm::FSM<Pipeline<minimize>, Stage>;
+  friend Base;
+ public:
+  static constexpr bool kMinimizeTable = minimize;
+
+  using Base::Base;
+
+ private:
+  using TransitionTable = typename Base::template Table<
+      typename Base::template BasicRow<kIdle, Go, kLeft1>,
+      typename Base::template BasicRow<kIdle, Alt, kRight1>,
+      typename Base::template BasicRow<kLeft1, Next, kLeft2>,
+      typename Base::template BasicRow<kRight1, Next, kRight2>,
+      typename Base::template BasicRow<kLeft2, Next, kDone>,
+      typename Base::template BasicRow<kRight2, Next, kDone>,
+      typename Base::template BasicRowFrom<typename Base::template StateSet<kLeft1, kRight1, kLeft2, kRight2>,
+                                           Cancel, kIdle>,
+      typename Base::template BasicRow<kDone, Reset, kIdle>>;
+};
+
+using Minimal = Pipeline<true>;
+using Plain = Pipeline<false>;
+
+// kParked and kLost are only reachable by construction; kB and kC are equivalent.
+enum Door { kA, kY, kB, kC, kParked = 6, kLost = 9 };
+
+struct Abort {};
+
+template<bool minimize>
+class Gate : public fsm::FSM<Gate<minimize>, Door> {
+  using Base = fsm::FSM<Gate<minimize>, Door>;
+  friend Base;
+ public:
+  static constexpr bool kMinimizeTable = minimize;
+
+  using Base::Base;
+
+ private:
+  using TransitionTable = typename Base::template Table<
+      typename Base::template BasicRow<kA, Go, kY>,
+      typename Base::template BasicRow<kA, Alt, kB>,
+      typename Base::template BasicRow<kY, Next, kC>,
+      typename Base::template BasicRowFrom<typename Base::template StateSet<kB, kC, kParked>, Reset, kA>,
+      typename Base::template BasicRowFrom<typename Base::AnyState, Abort, kA>>;
+};
+
+static_assert(Gate<true>::CanonicalState(kC) == kB, "");
+static_assert(Gate<true>::CanonicalState(kParked) == kB, "");
+static_assert(Gate<true>::CanonicalStateCount() == 4, "kA, kY, kB/kC/kParked and the states only aborting");
+
+static_assert(Minimal::CanonicalStateCount() == 4, "idle, left/right 1, left/right 2, done");
+static_assert(Minimal::CanonicalState(kRight1) == kLeft1, "");
+static_assert(Minimal::CanonicalState(kRight2) == kLeft2, "");
+static_assert(Minimal::CanonicalState(kDone) == kDone, "");
+static_assert(Minimal::CanonicalState(kUnused) == kUnused, "outside of the table");
+// smaller than a target per state and event, 6 * 5 cells
+static_assert(Minimal::MinimalTableBytes() == 6 + 4 * 5, "a class per state, a target per class and event");
+
+template<class Event>
+void DispatchBoth(Minimal &minimal, Plain &plain) {
+  minimal.Dispatch(Event{});
+  plain.Dispatch(Event{});
+}
+}
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "cert-err58-cpp"
+
+TEST_F(FSMTestSuite, TestMinimizedDispatch) {
+  Minimal machine{};
+  EXPECT_EQ(machine.Dispatch(Alt{}), kRight1);
+  // kLeft1 and kRight1 move to different states, so Next lands on the canonical one
+  EXPECT_EQ(machine.Dispatch(Next{}), kLeft2);
+  EXPECT_EQ(machine.Dispatch(Go{}), kLeft2);
+  EXPECT_EQ(machine.Dispatch(Next{}), kDone);
+  EXPECT_EQ(machine.Dispatch(Cancel{}), kDone);
+  EXPECT_EQ(machine.Dispatch(Reset{}), kIdle);
+
+  Minimal started{kRight2};
+  EXPECT_EQ(started.Dispatch(Next{}), kDone);
+}
+
+TEST_F(FSMTestSuite, TestMinimizedMatchesTable) {
+  for (unsigned seed = 0; seed < 64; ++seed) {
+    Minimal minimal{};
+    Plain plain{};
+    auto bits = seed * 2654435761u;
+    for (int step = 0; step < 16; ++step, bits /= 5) {
+      switch (bits % 5) {
+        case 0: DispatchBoth<Go>(minimal, plain); break;
+        case 1: DispatchBoth<Alt>(minimal, plain); break;
+        case 2: DispatchBoth<Next>(minimal, plain); break;
+        case 3: DispatchBoth<Cancel>(minimal, plain); break;
+        default: DispatchBoth<Reset>(minimal, plain); break;
+      }
+      EXPECT_EQ(Minimal::CanonicalState(minimal.CurrentState()), Minimal::CanonicalState(plain.CurrentState()));
+    }
+  }
+}
+
+TEST_F(FSMTestSuite, TestMinimizedKeepsTargets) {
+  // kY's only transition is shared by its class, but lands on kC, not kB
+  Gate<true> machine{};
+  EXPECT_EQ(machine.Dispatch(Go{}), kY);
+  EXPECT_EQ(machine.Dispatch(Next{}), kC);
+  EXPECT_EQ(machine.CurrentState(), kC);
+  EXPECT_EQ(machine.Dispatch(Reset{}), kA);
+  EXPECT_EQ(machine.Dispatch(Alt{}), kB);
+}
+
+TEST_F(FSMTestSuite, TestMinimizedOutsideNamedStates) {
+  // kParked is only named by a state set, kLost only matched by AnyState
+  Gate<true> parked{kParked};
+  EXPECT_EQ(parked.Dispatch(Reset{}), kA);
+
+  Gate<true> lost{kLost};
+  EXPECT_EQ(lost.Dispatch(Reset{}), kLost);
+  EXPECT_EQ(lost.Dispatch(Abort{}), kA);
+
+  Gate<true> unnamed{static_cast<Door>(200)};
+  Gate<false> plain{static_cast<Door>(200)};
+  EXPECT_EQ(unnamed.Dispatch(Abort{}), plain.Dispatch(Abort{}));
+  EXPECT_EQ(unnamed.CurrentState(), kA);
+}
+
+#pragma clang diagnostic pop
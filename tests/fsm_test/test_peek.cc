@@ -0,0 +1,142 @@
+//
+// Created by fanghr on 2020/5/13.
+//
+
+#include <atomic>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "fsm_test.h"
+
+namespace {
+class StateMachine : public fsm::FSM<StateMachine> {
+  friend class FSM;
+ public:
+  enum States { kInit, kEven, kOdd };
+
+  using Event = int;
+
+  explicit StateMachine(StateType state = kInit) : FSM(state) {}
+
+  int actions = 0;
+
+ private:
+  bool IsEven(const Event &event) const { return event % 2 == 0; }
+  void Count(const Event &) { ++actions; }
+
+  using TransitionTable = Table<
+  MemFnRow<kInit, Event, kEven, &StateMachine::Count, &StateMachine::IsEven>,
+  MemFnRow<kInit, Event, kOdd, &StateMachine::Count>,
+  MemFnRow<kEven, Event, kOdd, &StateMachine::Count>>;
+};
+
+// Non-recursive, so locking twice from one thread would hang.
+class Mutex : public fsm::detail::RWMutexInterface {
+ public:
+  void Lock() override { mutex_.lock(); }
+  void Unlock() override { mutex_.unlock(); }
+  void RLock() override { mutex_.lock(); }
+  void RUnlock() override { mutex_.unlock(); }
+
+ private:
+  std::mutex mutex_;
+};
+
+struct Step {};
+struct Probe {};
+
+class Counter : public fsm::FSM<Counter, int, std::atomic<bool>, Mutex> {
+  friend class FSM;
+ public:
+  enum States { kLow, kHigh };
+
+  int probed = -1;
+  mutable std::atomic<bool> torn{false};
+
+ private:
+  // `first` and `second` only differ while `Advance()` runs
+  void Advance(const Step &) {
+    ++first;
+    ++second;
+  }
+  bool IsConsistent(const Step &) const {
+    if (first != second)
+      torn = true;
+    return true;
+  }
+  void PeekFromAction(const Probe &) { probed = PeekLocked(Step{}).target; }
+
+  long first = 0, second = 0;
+
+  using TransitionTable = Table<
+  MemFnRow<kLow, Step, kHigh, &Counter::Advance, &Counter::IsConsistent>,
+  MemFnRow<kHigh, Step, kLow, &Counter::Advance, &Counter::IsConsistent>,
+  MemFnRow<kLow, Probe, kLow, &Counter::PeekFromAction>>;
+};
+}
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "cert-err58-cpp"
+
+TEST_F(FSMTestSuite, TestPeekTransition) {
+  StateMachine machine{};
+
+  auto even = machine.PeekTransition(2);
+  EXPECT_TRUE(even.matched);
+  EXPECT_EQ(even.target, StateMachine::kEven);
+  EXPECT_EQ(even.row, 0u);
+
+  auto odd = machine.PeekTransition(1);
+  EXPECT_TRUE(odd.matched);
+  EXPECT_EQ(odd.target, StateMachine::kOdd);
+  EXPECT_EQ(odd.row, 1u);
+
+  EXPECT_EQ(machine.CurrentState(), StateMachine::kInit);
+  EXPECT_EQ(machine.actions, 0);
+
+  machine(1);
+  auto none = machine.PeekTransition(1);
+  EXPECT_FALSE(none.matched);
+  EXPECT_EQ(none.target, StateMachine::kOdd);
+}
+
+TEST_F(FSMTestSuite, TestPeekTransitions) {
+  std::vector<StateMachine> machines{StateMachine{}, StateMachine{StateMachine::kEven}, StateMachine{StateMachine::kOdd}};
+  std::vector<StateMachine::PeekResult> results(machines.size());
+  StateMachine::PeekTransitions(machines.begin(), machines.end(), 4, results.begin());
+  EXPECT_EQ(results[0].target, StateMachine::kEven);
+  EXPECT_EQ(results[1].target, StateMachine::kOdd);
+  EXPECT_EQ(results[1].row, 2u);
+  EXPECT_FALSE(results[2].matched);
+
+  std::vector<const StateMachine *> pointers{&machines[2], &machines[0]};
+  std::vector<StateMachine::PeekResult> more;
+  StateMachine::PeekTransitions(pointers.begin(), pointers.end(), 3, std::back_inserter(more));
+  ASSERT_EQ(more.size(), 2u);
+  EXPECT_FALSE(more[0].matched);
+  EXPECT_EQ(more[1].target, StateMachine::kOdd);
+}
+
+TEST_F(FSMTestSuite, TestPeekFromAction) {
+  Counter counter{};
+  counter(Probe{});
+  EXPECT_EQ(counter.probed, Counter::kHigh);
+}
+
+TEST_F(FSMTestSuite, TestPeekConcurrentDispatch) {
+  Counter counter{};
+  std::atomic<bool> done{false};
+  std::thread dispatcher([&] {
+    for (int i = 0; i < 100000; ++i)
+      counter(Step{});
+    done = true;
+  });
+  while (!done)
+    EXPECT_TRUE(counter.PeekTransition(Step{}).matched);
+  dispatcher.join();
+  EXPECT_FALSE(counter.torn);
+}
+
+#pragma clang diagnostic pop
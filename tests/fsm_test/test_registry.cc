@@ -0,0 +1,117 @@
+//
+// Created by fanghr on 2020/5/19.
+//
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <fsm/registry.h>
+
+#include "fsm_test.h"
+
+namespace {
+struct Connect {};
+struct Reload {};
+struct Shutdown {};
+struct Evict {};
+
+class Connection : public fsm::FSM<Connection> {
+  friend class FSM;
+ public:
+  enum States { kIdle, kConnected, kClosed };
+
+  using Registry = fsm::MachineRegistry<Connection>;
+
+  explicit Connection(Registry &registry) : registry_(registry), id_(registry.Add(*this)) {}
+
+  ~Connection() { registry_.Remove(id_); }
+
+  int reloads = 0;
+  std::function<void()> on_evict;
+
+ private:
+  void OnStateChange(StateType from, StateType to) {
+    registry_.Moved(id_, from, to);
+  }
+
+  void CountReload(const Reload &) { ++reloads; }
+  void RunEvict(const Evict &) {
+    if (on_evict)
+      on_evict();
+  }
+
+  using TransitionTable = Table<
+  BasicRow<kIdle, Connect, kConnected>,
+  MemFnRow<kConnected, Reload, kConnected, &Connection::CountReload>,
+  BasicRow<kIdle, Shutdown, kClosed>,
+  BasicRow<kConnected, Shutdown, kClosed>,
+  MemFnRow<kConnected, Evict, kClosed, &Connection::RunEvict>>;
+
+  Registry &registry_;
+  Registry::Id id_;
+};
+}
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "cert-err58-cpp"
+
+TEST_F(FSMTestSuite, TestHasTransition) {
+  EXPECT_TRUE(Connection::HasTransition<Connect>(Connection::kIdle));
+  EXPECT_FALSE(Connection::HasTransition<Connect>(Connection::kConnected));
+  EXPECT_TRUE(Connection::HasTransition<Shutdown>(Connection::kConnected));
+  EXPECT_FALSE(Connection::HasTransition<Shutdown>(Connection::kClosed));
+}
+
+TEST_F(FSMTestSuite, TestRegistryBroadcast) {
+  Connection::Registry registry;
+  std::vector<std::unique_ptr<Connection>> connections;
+  for (int i = 0; i < 200; ++i)
+    connections.emplace_back(new Connection(registry));
+  EXPECT_EQ(registry.Count(Connection::kIdle), 200u);
+
+  for (int i = 0; i < 200; i += 3)
+    connections[i]->Dispatch(Connect{});
+  EXPECT_EQ(registry.Count(Connection::kIdle), 133u);
+  EXPECT_EQ(registry.Count(Connection::kConnected), 67u);
+
+  // only connected machines are visited
+  EXPECT_EQ(registry.Broadcast<Reload>(), 67u);
+  for (int i = 0; i < 200; ++i)
+    EXPECT_EQ(connections[i]->reloads, i % 3 == 0 ? 1 : 0);
+
+  connections.erase(connections.begin());
+  EXPECT_EQ(registry.Count(Connection::kConnected), 66u);
+  connections.emplace_back(new Connection(registry));
+  EXPECT_EQ(registry.Count(Connection::kIdle), 134u);
+
+  EXPECT_EQ(registry.Broadcast<Shutdown>(), 200u);
+  EXPECT_EQ(registry.Count(Connection::kClosed), 200u);
+  EXPECT_EQ(registry.Broadcast<Shutdown>(), 0u);
+}
+
+TEST_F(FSMTestSuite, TestRegistryRemoveDuringBroadcast) {
+  Connection::Registry registry;
+  std::vector<std::unique_ptr<Connection>> connections;
+  for (int i = 0; i < 10; ++i) {
+    connections.emplace_back(new Connection(registry));
+    connections.back()->Dispatch(Connect{});
+  }
+
+  // the first machine evicted drops every other connected machine and
+  // registers a new one, which may not take over a pending target's id
+  connections[0]->on_evict = [&registry, &connections] {
+    for (int i = 1; i < 10; i += 2)
+      connections[i].reset();
+    connections.emplace_back(new Connection(registry));
+    connections.back()->Dispatch(Connect{});
+  };
+  EXPECT_EQ(registry.Broadcast<Evict>(), 5u);
+  for (int i = 0; i < 10; i += 2)
+    EXPECT_EQ(connections[i]->CurrentState(), Connection::kClosed);
+  EXPECT_EQ(connections.back()->CurrentState(), Connection::kConnected);
+  EXPECT_EQ(registry.Count(Connection::kClosed), 5u);
+  EXPECT_EQ(registry.Count(Connection::kConnected), 1u);
+}
+
+#pragma clang diagnostic pop
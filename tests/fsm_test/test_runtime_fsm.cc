@@ -0,0 +1,97 @@
+//
+// Created by fanghr on 2020/5/12.
+//
+
+#include <fsm/runtime_fsm.h>
+
+#include "fsm_test.h"
+
+namespace {
+class StateMachine : public fsm::RuntimeFSM<StateMachine, int> {
+  friend class fsm::RuntimeFSM<StateMachine, int>;
+ public:
+  explicit StateMachine(std::shared_ptr<const TableType> table) : RuntimeFSM(std::move(table)) {}
+
+  static const RegistryType &Registry() {
+    static RegistryType registry = [] {
+      RegistryType r;
+      r.AddAction<&StateMachine::Store>("Store")
+          .AddAction("Clear", [](StateMachine &self, const int &) { self.value_ = 0; })
+          .AddGuard<&StateMachine::IsPositive>("IsPositive");
+      return r;
+    }();
+    return registry;
+  }
+
+  int Value() const { return value_; }
+
+ private:
+  void Store(const int &i) { value_ = i; }
+  bool IsPositive(const int &i) const { return i > 0; }
+
+  StateType NoTransition(EventId, const int &) {
+    return Table().StateIndex("Error");
+  }
+
+  int value_ = 0;
+};
+
+const char *kTable = R"(
+# a tiny runtime table
+states Init Running Exit Error
+events set stop
+
+Init    set  Running Store IsPositive
+Running set  Running Store IsPositive
+Running set  Running -     -          # ignore non-positive values
+Running stop Exit    Clear
+)";
+}
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "cert-err58-cpp"
+
+TEST_F(FSMTestSuite, TestRuntimeFSM) {
+  auto table = StateMachine::TableType::Parse(kTable, StateMachine::Registry());
+  StateMachine machine{table};
+  EXPECT_EQ(machine.CurrentStateName(), "Init");
+  machine.Dispatch("set", 42);
+  EXPECT_EQ(machine.CurrentStateName(), "Running");
+  EXPECT_EQ(machine.Value(), 42);
+  machine.Dispatch("set", -1);
+  EXPECT_EQ(machine.CurrentStateName(), "Running");
+  EXPECT_EQ(machine.Value(), 42);
+  machine.Dispatch(table->EventIndex("stop"));
+  EXPECT_EQ(machine.CurrentStateName(), "Exit");
+  EXPECT_EQ(machine.Value(), 0);
+  machine.Dispatch("set", 1);
+  EXPECT_EQ(machine.CurrentStateName(), "Error");
+}
+
+TEST_F(FSMTestSuite, TestRuntimeFSMEventOutOfRange) {
+  auto table = StateMachine::TableType::Parse(kTable, StateMachine::Registry());
+  StateMachine machine{table};
+  machine.Dispatch("set", 42);
+  EXPECT_EQ(machine.CurrentStateName(), "Running");
+  machine.Dispatch(static_cast<StateMachine::EventId>(table->EventCount()), 1);
+  EXPECT_EQ(machine.CurrentStateName(), "Error");
+  EXPECT_EQ(machine.Value(), 42);
+
+  auto rows = table->Rows(0, 1000);
+  EXPECT_EQ(rows.first, rows.second);
+  rows = table->Rows(1000, 0);
+  EXPECT_EQ(rows.first, rows.second);
+}
+
+TEST_F(FSMTestSuite, TestRuntimeFSMParseError) {
+  EXPECT_THROW(StateMachine::TableType::Parse("states A\nevents e\nA e B\n", StateMachine::Registry()),
+               std::invalid_argument);
+  EXPECT_THROW(StateMachine::TableType::Parse("states A\nevents e\nA e A Missing\n", StateMachine::Registry()),
+               std::invalid_argument);
+  EXPECT_THROW(StateMachine::TableType::Parse("states A A\n", StateMachine::Registry()),
+               std::invalid_argument);
+  EXPECT_THROW(StateMachine::TableType::Parse("events e\n", StateMachine::Registry()),
+               std::invalid_argument);
+}
+
+#pragma clang diagnostic pop
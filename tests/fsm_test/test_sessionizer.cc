@@ -0,0 +1,202 @@
+//
+// Created by fanghr on 2020/5/21.
+//
+
+#if defined(__unix__)
+
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <fsm/runtime_fsm.h>
+#include <fsm/sessionizer.h>
+
+#include "fsm_test.h"
+
+namespace {
+class Session : public fsm::RuntimeFSM<Session, std::uint32_t> {
+  friend class fsm::RuntimeFSM<Session, std::uint32_t>;
+ public:
+  explicit Session(std::shared_ptr<const TableType> table) : RuntimeFSM(std::move(table)) {}
+
+  static const RegistryType &Registry() {
+    static RegistryType registry = [] {
+      RegistryType r;
+      r.AddGuard("Large", [](const Session &, const std::uint32_t &bytes) { return bytes >= 1000; });
+      return r;
+    }();
+    return registry;
+  }
+};
+
+const char *kTable = R"(
+states Offline Online Heavy
+events login data logout
+Offline login  Online
+Online  data   Heavy   -  Large
+Online  logout Offline
+Heavy   logout Offline
+)";
+
+using Sessionizer = fsm::Sessionizer<Session, std::uint32_t>;
+
+std::string TempPath(const char *name) {
+  return ::testing::TempDir() + "fsm_sessionizer_" + name;
+}
+
+template<class T>
+std::vector<T> ReadAll(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  std::vector<char> bytes{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+  std::vector<T> values(bytes.size() / sizeof(T));
+  std::memcpy(values.data(), bytes.data(), values.size() * sizeof(T));
+  return values;
+}
+}
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "cert-err58-cpp"
+
+TEST_F(FSMTestSuite, TestSessionizer) {
+  auto table = Session::TableType::Parse(kTable, Session::Registry());
+  auto login = table->EventIndex("login"), data = table->EventIndex("data"), logout = table->EventIndex("logout");
+
+  // 100 keys, each logging in, sending a few small and large packets and
+  // logging out; keys with key % 3 == 0 stay online at the end
+  std::vector<Sessionizer::Record> log;
+  for (std::uint32_t round = 0; round < 4; ++round) {
+    for (std::uint64_t key = 0; key < 100; ++key) {
+      switch (round) {
+        case 0: log.push_back({key, login, 0});
+          break;
+        case 1: log.push_back({key, data, key % 2 ? 10u : 5000u});
+          break;
+        case 2: log.push_back({key, data, key % 2 ? 20u : 5000u});
+          break;
+        default:
+          if (key % 3 != 0)
+            log.push_back({key, logout, 0});
+      }
+    }
+  }
+  auto log_path = TempPath("log"), transitions_path = TempPath("transitions"), states_path = TempPath("states");
+  {
+    std::ofstream out(log_path, std::ios::binary);
+    out.write(reinterpret_cast<const char *>(log.data()), log.size() * sizeof(log[0]));
+  }
+
+  // reference: sequential replay
+  std::map<std::uint64_t, std::vector<Sessionizer::Transition>> expected;
+  {
+    std::map<std::uint64_t, std::unique_ptr<Session>> machines;
+    for (std::uint64_t i = 0; i < log.size(); ++i) {
+      auto &machine = machines[log[i].key];
+      if (!machine)
+        machine.reset(new Session(table));
+      auto from = machine->CurrentState();
+      machine->Dispatch(log[i].event, log[i].payload);
+      if (from != machine->CurrentState())
+        expected[log[i].key].push_back({log[i].key, i, from, machine->CurrentState()});
+    }
+  }
+
+  Sessionizer sessionizer([&table](void *storage, std::uint64_t) { new(storage) Session(table); });
+  Sessionizer::Options options;
+  options.threads = 4;
+  options.transitions_path = transitions_path;
+  options.final_states_path = states_path;
+  options.event_count = static_cast<std::uint32_t>(table->EventCount());
+  auto result = sessionizer.Run(log_path, options);
+  EXPECT_EQ(result.records, log.size());
+  EXPECT_EQ(result.keys, 100u);
+
+  std::map<std::uint64_t, std::vector<Sessionizer::Transition>> actual;
+  for (auto &transition : ReadAll<Sessionizer::Transition>(transitions_path))
+    actual[transition.key].push_back(transition);
+  ASSERT_EQ(actual.size(), expected.size());
+  std::size_t transitions = 0;
+  for (auto &key : expected) {
+    ASSERT_EQ(actual[key.first].size(), key.second.size());
+    for (std::size_t i = 0; i < key.second.size(); ++i) {
+      EXPECT_EQ(actual[key.first][i].record, key.second[i].record);
+      EXPECT_EQ(actual[key.first][i].from, key.second[i].from);
+      EXPECT_EQ(actual[key.first][i].to, key.second[i].to);
+    }
+    transitions += key.second.size();
+  }
+  EXPECT_EQ(result.transitions, transitions);
+
+  // padding is written as zeros
+  constexpr auto kUsed = offsetof(Sessionizer::FinalState, state) + sizeof(Session::StateType);
+  static_assert(kUsed < sizeof(Sessionizer::FinalState), "FinalState should have padding");
+  auto bytes = ReadAll<char>(states_path);
+  for (std::size_t i = 0; i < bytes.size(); ++i) {
+    if (i % sizeof(Sessionizer::FinalState) >= kUsed) {
+      EXPECT_EQ(bytes[i], 0) << i;
+    }
+  }
+
+  auto states = ReadAll<Sessionizer::FinalState>(states_path);
+  ASSERT_EQ(states.size(), 100u);
+  for (auto &state : states) {
+    auto name = table->StateName(state.state);
+    EXPECT_EQ(name, state.key % 3 != 0 ? "Offline" : state.key % 2 ? "Online" : "Heavy") << state.key;
+  }
+
+  std::remove(log_path.c_str());
+  std::remove(transitions_path.c_str());
+  std::remove(states_path.c_str());
+}
+
+TEST_F(FSMTestSuite, TestSessionizerErrors) {
+  Sessionizer sessionizer([](void *, std::uint64_t) {});
+  EXPECT_THROW(sessionizer.Run(TempPath("missing"), Sessionizer::Options{}), std::system_error);
+
+  auto path = TempPath("truncated");
+  {
+    std::ofstream out(path, std::ios::binary);
+    out << "abc";
+  }
+  EXPECT_THROW(sessionizer.Run(path, Sessionizer::Options{}), std::invalid_argument);
+  std::remove(path.c_str());
+}
+
+TEST_F(FSMTestSuite, TestSessionizerEventOutOfRange) {
+  auto table = Session::TableType::Parse(kTable, Session::Registry());
+  std::vector<Sessionizer::Record> log{{1, 0, 0}, {2, 0, 0}, {1, 7, 0}, {2, 1, 0}};
+  auto log_path = TempPath("bad_event"), states_path = TempPath("bad_event_states");
+  {
+    std::ofstream out(log_path, std::ios::binary);
+    out.write(reinterpret_cast<const char *>(log.data()), log.size() * sizeof(log[0]));
+  }
+
+  int machines = 0;
+  Sessionizer sessionizer([&](void *storage, std::uint64_t) {
+    ++machines;
+    new(storage) Session(table);
+  });
+  Sessionizer::Options options;
+  options.threads = 2;
+  options.final_states_path = states_path;
+  options.event_count = static_cast<std::uint32_t>(table->EventCount());
+  EXPECT_THROW(sessionizer.Run(log_path, options), std::out_of_range);
+  // the log is checked before any record is replayed
+  EXPECT_EQ(machines, 0);
+
+  // without a count every id goes to the machine, which has no row for it
+  options.event_count = 0;
+  auto result = sessionizer.Run(log_path, options);
+  EXPECT_EQ(result.records, 4u);
+  EXPECT_EQ(result.keys, 2u);
+
+  std::remove(log_path.c_str());
+  std::remove(states_path.c_str());
+}
+
+#pragma clang diagnostic pop
+
+#endif
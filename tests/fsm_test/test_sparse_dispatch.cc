@@ -0,0 +1,103 @@
+//
+// Created by fanghr on 2020/5/13.
+//
+
+#include <cstdint>
+
+#include "fsm_test.h"
+
+namespace {
+// Status codes taken from a protocol spec: wide and sparse.
+enum Status : std::uint32_t {
+  kIdle = 0x00000000u,
+  kConnecting = 0x00010000u,
+  kConnected = 0x00020001u,
+  kAuthenticating = 0x10000000u,
+  kReady = 0x20000003u,
+  kClosed = 0xffff0000u,
+  kError = 0xffffffffu,
+};
+
+class SparseMachine : public fsm::FSM<SparseMachine, Status> {
+  friend class FSM;
+ public:
+  using Event = int;
+
+  SparseMachine() : FSM(kIdle) {}
+
+ private:
+  bool IsZero(const Event &event) const { return event == 0; }
+
+  StateType NoTransition(const Event &) { return kError; }
+
+  using TransitionTable = Table<
+  MemFnRow<kIdle, Event, kConnecting>,
+  MemFnRow<kConnecting, Event, kClosed, nullptr, &SparseMachine::IsZero>,
+  MemFnRow<kConnecting, Event, kConnected>,
+  MemFnRow<kConnected, Event, kAuthenticating>,
+  MemFnRow<kAuthenticating, Event, kReady>,
+  MemFnRow<kReady, Event, kClosed, nullptr, &SparseMachine::IsZero>,
+  MemFnRow<kClosed, Event, kIdle>>;
+};
+
+enum State { kS0, kS1, kS2, kS3, kS4, kS5, kS6, kS7, kSink };
+
+class DenseMachine : public fsm::FSM<DenseMachine, State> {
+  friend class FSM;
+ public:
+  using Event = int;
+
+  explicit DenseMachine(State state) : FSM(state) {}
+
+ private:
+  bool IsOdd(const Event &event) const { return event % 2 != 0; }
+
+  using TransitionTable = Table<
+  MemFnRow<kS0, Event, kS1>,
+  MemFnRow<kS1, Event, kS2>,
+  MemFnRow<kS2, Event, kS3>,
+  MemFnRow<kS3, Event, kSink, nullptr, &DenseMachine::IsOdd>,
+  MemFnRow<kS3, Event, kS4>,
+  MemFnRow<kS4, Event, kS5>,
+  MemFnRow<kS6, Event, kS7>,
+  MemFnRow<kS7, Event, kS0>>;
+};
+}
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "cert-err58-cpp"
+
+TEST_F(FSMTestSuite, TestSparseDispatch) {
+  SparseMachine machine{};
+  EXPECT_EQ(machine(1), kConnecting);
+  EXPECT_EQ(machine(1), kConnected);
+  EXPECT_EQ(machine(1), kAuthenticating);
+  EXPECT_EQ(machine(1), kReady);
+  EXPECT_EQ(machine(1), kError); // no row matches: guard fails
+  EXPECT_EQ(machine(1), kError); // no row at all
+}
+
+TEST_F(FSMTestSuite, TestSparseDispatchGuardOrder) {
+  SparseMachine machine{};
+  EXPECT_EQ(machine(1), kConnecting);
+  EXPECT_EQ(machine(0), kClosed);
+  EXPECT_EQ(machine(1), kIdle);
+}
+
+TEST_F(FSMTestSuite, TestDenseDispatch) {
+  DenseMachine machine{kS0};
+  EXPECT_EQ(machine(0), kS1);
+  EXPECT_EQ(machine(0), kS2);
+  EXPECT_EQ(machine(0), kS3);
+  EXPECT_EQ(machine(0), kS4);
+  EXPECT_EQ(machine(0), kS5);
+  EXPECT_EQ(machine(0), kS5); // no row from kS5
+  DenseMachine odd{kS3};
+  EXPECT_EQ(odd(1), kSink);
+  EXPECT_EQ(odd(1), kSink); // kSink is beyond the table
+  DenseMachine wrap{kS6};
+  EXPECT_EQ(wrap(0), kS7);
+  EXPECT_EQ(wrap(0), kS0);
+}
+
+#pragma clang diagnostic pop
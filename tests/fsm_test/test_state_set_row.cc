@@ -0,0 +1,143 @@
+//
+// Created by fanghr on 2020/5/21.
+//
+
+#include "fsm_test.h"
+
+namespace {
+struct Play {};
+struct Pause {};
+struct OpenClose {};
+struct Error {};
+struct Reset {};
+struct Stop {};
+
+class Player : public fsm::FSM<Player> {
+  friend class FSM;
+ public:
+  enum States { kEmpty, kOpen, kStopped, kPlaying, kPaused, kBroken };
+
+  explicit Player(StateType state = kEmpty) : FSM(state) {}
+
+  int ejects = 0;
+  int errors = 0;
+  int resets = 0;
+  bool refuse_reset = false;
+
+ private:
+  void Eject(const OpenClose &) { ++ejects; }
+  void Fail(const Error &) { ++errors; }
+  void CountReset(const Reset &) { ++resets; }
+  bool MayReset(const Reset &) const { return !refuse_reset; }
+
+  using TransitionTable = Table<
+  BasicRow<kEmpty, Play, kEmpty>,
+  BasicRow<kStopped, Play, kPlaying>,
+  BasicRow<kPaused, Play, kPlaying>,
+  BasicRow<kPlaying, Pause, kPaused>,
+  BasicRow<kOpen, OpenClose, kEmpty>,
+  BasicRow<kEmpty, OpenClose, kOpen>,
+  MemFnRowFrom<StateSet<kStopped, kPlaying, kPaused>, OpenClose, kOpen, &Player::Eject>,
+  // listed before the specific row below, but only tried after it
+  MemFnRowFrom<AnyState, Error, kBroken, &Player::Fail>,
+  BasicRow<kBroken, Error, kBroken>,
+  MemFnRowFrom<AnyState, Reset, kEmpty, &Player::CountReset, &Player::MayReset>,
+  BasicRowFrom<StateSet<kPlaying>, Reset, kStopped>,
+  // enough start states for keyed dispatch
+  BasicRow<kEmpty, Stop, kEmpty>,
+  BasicRow<kOpen, Stop, kOpen>,
+  BasicRow<kStopped, Stop, kStopped>,
+  BasicRow<kPlaying, Stop, kStopped>,
+  BasicRow<kPaused, Stop, kStopped>,
+  BasicRowFrom<StateSet<kPlaying, kBroken>, Stop, kEmpty>>;
+};
+
+class Small : public fsm::FSM<Small> {
+  friend class FSM;
+ public:
+  enum States { kA, kB, kC };
+
+  explicit Small(StateType state = kA) : FSM(state) {}
+
+ private:
+  using TransitionTable = Table<
+  BasicRowFrom<AnyState, Reset, kA>,
+  BasicRowFrom<StateSet<kA, kB>, Play, kC>,
+  BasicRow<kB, Play, kA>>;
+};
+}
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "cert-err58-cpp"
+
+TEST_F(FSMTestSuite, TestStateSetRow) {
+  for (auto state : {Player::kStopped, Player::kPlaying, Player::kPaused}) {
+    Player player{state};
+    player(OpenClose{});
+    EXPECT_EQ(player.CurrentState(), Player::kOpen);
+    EXPECT_EQ(player.ejects, 1);
+  }
+
+  Player player{};
+  player(OpenClose{});
+  EXPECT_EQ(player.CurrentState(), Player::kOpen);
+  EXPECT_EQ(player.ejects, 0);
+  player(OpenClose{});
+  EXPECT_EQ(player.CurrentState(), Player::kEmpty);
+
+  EXPECT_FALSE(Player::HasTransition<Pause>(Player::kEmpty));
+  EXPECT_TRUE(Player::HasTransition<OpenClose>(Player::kPaused));
+  EXPECT_FALSE(Player::HasTransition<OpenClose>(Player::kBroken));
+  EXPECT_TRUE(Player::HasTransition<Error>(Player::kBroken));
+}
+
+TEST_F(FSMTestSuite, TestStateSetRowPrecedence) {
+  Player player{Player::kPlaying};
+  player(Error{});
+  EXPECT_EQ(player.CurrentState(), Player::kBroken);
+  EXPECT_EQ(player.errors, 1);
+
+  // the specific row wins over the earlier AnyState row
+  player(Error{});
+  EXPECT_EQ(player.CurrentState(), Player::kBroken);
+  EXPECT_EQ(player.errors, 1);
+  EXPECT_EQ(player.PeekTransition(Error{}).row, 8u);
+
+  player(Reset{});
+  EXPECT_EQ(player.CurrentState(), Player::kEmpty);
+  EXPECT_EQ(player.resets, 1);
+
+  // StateSet<...> wins over AnyState; a failing guard falls through to the next row
+  player = Player{Player::kPlaying};
+  player(Reset{});
+  EXPECT_EQ(player.CurrentState(), Player::kStopped);
+  EXPECT_EQ(player.resets, 0);
+  player.refuse_reset = true;
+  player(Reset{});
+  EXPECT_EQ(player.CurrentState(), Player::kStopped);
+}
+
+TEST_F(FSMTestSuite, TestStateSetRowKeyed) {
+  Player playing{Player::kPlaying};
+  playing(Stop{});
+  EXPECT_EQ(playing.CurrentState(), Player::kStopped);
+
+  Player broken{Player::kBroken};
+  broken(Stop{});
+  EXPECT_EQ(broken.CurrentState(), Player::kEmpty);
+  EXPECT_TRUE(Player::HasTransition<Stop>(Player::kBroken));
+}
+
+TEST_F(FSMTestSuite, TestStateSetRowLinear) {
+  Small b{Small::kB};
+  b(Play{});
+  EXPECT_EQ(b.CurrentState(), Small::kA);
+  b(Play{});
+  EXPECT_EQ(b.CurrentState(), Small::kC);
+  b(Play{});
+  EXPECT_EQ(b.CurrentState(), Small::kC);
+  b(Reset{});
+  EXPECT_EQ(b.CurrentState(), Small::kA);
+}
+
+#pragma clang diagnostic pop
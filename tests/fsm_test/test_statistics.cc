@@ -0,0 +1,77 @@
+//
+// Created by fanghr on 2020/5/12.
+//
+
+#include <fsm/statistics.h>
+
+#include "fsm_test.h"
+
+namespace {
+enum State { kInit, kRunning, kExit };
+
+class StatisticsMachine : public fsm::FSM<StatisticsMachine, State, bool, fsm::detail::DefaultRWMutex,
+                                          fsm::detail::PlainState<State>, fsm::Statistics<1>> {
+  friend class FSM;
+ public:
+  struct Start {};
+  struct Stop {};
+  struct Tick {};
+
+  StatisticsMachine() : FSM(kInit) {}
+
+ private:
+  using TransitionTable = Table<
+  BasicRow<kInit, Start, kRunning>,
+  BasicRow<kRunning, Stop, kExit>,
+  BasicRow<kRunning, Tick, kRunning>>;
+};
+
+bool Contains(const std::string &text, const std::string &line) {
+  return text.find(line) != std::string::npos;
+}
+}
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "cert-err58-cpp"
+
+TEST_F(FSMTestSuite, TestStatistics) {
+  for (int i = 0; i < 3; ++i) {
+    StatisticsMachine machine{};
+    machine(StatisticsMachine::Start{});
+    machine(StatisticsMachine::Start{});
+    machine(StatisticsMachine::Tick{});
+    machine(StatisticsMachine::Tick{});
+    machine(StatisticsMachine::Stop{});
+  }
+
+  auto text = fsm::Statistics<>::Dump();
+  const std::string machine = "machine=\"(anonymous namespace)::StatisticsMachine\"";
+  EXPECT_TRUE(Contains(text, "# TYPE fsm_transitions_total counter\n"));
+  EXPECT_TRUE(Contains(text, "fsm_transitions_total{" + machine + ",row=\"0\",from=\"0\",to=\"1\"} 3\n"));
+  EXPECT_TRUE(Contains(text, "fsm_transitions_total{" + machine + ",row=\"1\",from=\"1\",to=\"2\"} 3\n"));
+  EXPECT_TRUE(Contains(text, "fsm_transitions_total{" + machine + ",row=\"2\",from=\"1\",to=\"1\"} 6\n"));
+  EXPECT_TRUE(Contains(text, "fsm_state_entries_total{" + machine + ",state=\"1\"} 3\n"));
+  EXPECT_TRUE(Contains(text, "fsm_state_entries_total{" + machine + ",state=\"2\"} 3\n"));
+  EXPECT_TRUE(Contains(text, "fsm_no_transition_total{" + machine
+      + ",state=\"1\",event=\"(anonymous namespace)::StatisticsMachine::Start\"} 3\n"));
+  EXPECT_TRUE(Contains(text, "# TYPE fsm_action_duration_seconds histogram\n"));
+  EXPECT_TRUE(Contains(text, "fsm_action_duration_seconds_count{" + machine + ",row=\"0\"} 3\n"));
+  EXPECT_TRUE(Contains(text, "fsm_action_duration_seconds_bucket{" + machine + ",row=\"0\",le=\"+Inf\"} 3\n"));
+  // `le` is inclusive: the first bucket only holds 0 ns, the fourth up to 3 ns
+  EXPECT_TRUE(Contains(text, "fsm_action_duration_seconds_bucket{" + machine + ",row=\"0\",le=\"0\"} "));
+  EXPECT_TRUE(Contains(text, "fsm_action_duration_seconds_bucket{" + machine + ",row=\"0\",le=\"3e-09\"} "));
+}
+
+TEST_F(FSMTestSuite, TestStatisticsBuckets) {
+  using Registry = fsm::detail::StatisticsRegistry;
+  for (std::uint64_t ns : {0ull, 1ull, 3ull, 4ull, 5ull, 7ull, 8ull, 1000ull, 123456789ull}) {
+    auto bucket = Registry::BucketOf(ns);
+    EXPECT_LT(ns, Registry::UpperBoundOf(bucket));
+    if (bucket > 0) {
+      EXPECT_GE(ns, Registry::UpperBoundOf(bucket - 1));
+    }
+  }
+  EXPECT_EQ(Registry::BucketOf(~0ull), Registry::kBuckets - 1);
+}
+
+#pragma clang diagnostic pop
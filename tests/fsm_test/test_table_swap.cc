@@ -0,0 +1,144 @@
+//
+// Created by fanghr on 2020/5/19.
+//
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <fsm/runtime_fsm.h>
+
+#include "fsm_test.h"
+
+namespace {
+class StateMachine;
+
+using Handle = fsm::RuntimeTableHandle<StateMachine, int>;
+using Source = fsm::SharedTableSource<StateMachine, int>;
+
+class StateMachine : public fsm::RuntimeFSM<StateMachine, int, Source> {
+  friend class fsm::RuntimeFSM<StateMachine, int, Source>;
+ public:
+  explicit StateMachine(const Handle &handle, StateType init = 0) : RuntimeFSM(handle, init) {}
+
+  static const RegistryType &Registry() {
+    static RegistryType registry;
+    return registry;
+  }
+};
+
+const char *kV1 = R"(
+states Idle Busy Done
+events go stop
+Idle go   Busy
+Busy stop Done
+)";
+
+// Busy is split into Working and Paused; Done is renamed to Finished
+const char *kV2 = R"(
+states Working Paused Idle Finished
+events pause go stop
+Idle    go    Working
+Working pause Paused
+Paused  go    Working
+Working stop  Finished
+Paused  stop  Finished
+)";
+
+// Working and Paused are merged back into one state
+const char *kV3 = R"(
+states Idle Busy Finished
+events go stop pause
+Idle go   Busy
+Busy stop Finished
+)";
+}
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "cert-err58-cpp"
+
+TEST_F(FSMTestSuite, TestTableRebase) {
+  auto v1 = StateMachine::TableType::Parse(kV1, StateMachine::Registry());
+  auto v2 = StateMachine::TableType::Parse(kV2, StateMachine::Registry());
+
+  auto rebased = v2->Rebase(*v1, [](const std::string &name) -> std::string {
+    if (name == "Busy")
+      return "Working";
+    if (name == "Done")
+      return "Finished";
+    return name;
+  });
+  // old indices keep their meaning, new states and events are appended
+  EXPECT_EQ(rebased->StateIndex("Idle"), v1->StateIndex("Idle"));
+  EXPECT_EQ(rebased->StateIndex("Working"), v1->StateIndex("Busy"));
+  EXPECT_EQ(rebased->StateIndex("Finished"), v1->StateIndex("Done"));
+  EXPECT_EQ(rebased->StateIndex("Paused"), 3u);
+  EXPECT_EQ(rebased->EventIndex("go"), v1->EventIndex("go"));
+  EXPECT_EQ(rebased->EventIndex("stop"), v1->EventIndex("stop"));
+  EXPECT_EQ(rebased->EventIndex("pause"), 2u);
+
+  // without a mapping Busy has no counterpart
+  EXPECT_THROW(v2->Rebase(*v1), std::invalid_argument);
+
+  // merging states turns the later ones into aliases sharing rows and name
+  auto v3 = StateMachine::TableType::Parse(kV3, StateMachine::Registry());
+  auto merged = v3->Rebase(*rebased, [](const std::string &name) -> std::string {
+    return name == "Working" || name == "Paused" ? "Busy" : name;
+  });
+  EXPECT_EQ(merged->StateCount(), 4u);
+  EXPECT_EQ(merged->StateName(3), "Busy");
+  auto stop = merged->Rows(3, merged->EventIndex("stop"));
+  ASSERT_EQ(stop.second - stop.first, 1);
+  EXPECT_EQ(stop.first->target, merged->StateIndex("Finished"));
+  auto pause = merged->Rows(3, merged->EventIndex("pause"));
+  EXPECT_EQ(pause.first, pause.second);
+}
+
+TEST_F(FSMTestSuite, TestTableHotSwap) {
+  Handle handle{StateMachine::TableType::Parse(kV1, StateMachine::Registry())};
+  StateMachine machine{handle};
+  machine.Dispatch("go");
+  EXPECT_EQ(machine.CurrentStateName(), "Busy");
+
+  handle.Publish(*StateMachine::TableType::Parse(kV2, StateMachine::Registry()),
+                 [](const std::string &name) -> std::string {
+                   return name == "Busy" ? "Working" : name == "Done" ? "Finished" : name;
+                 });
+  EXPECT_EQ(handle.Reclaim(), 0u);
+  EXPECT_EQ(machine.CurrentStateName(), "Working");
+  machine.Dispatch("pause");
+  EXPECT_EQ(machine.CurrentStateName(), "Paused");
+  machine.Dispatch("stop");
+  EXPECT_EQ(machine.CurrentStateName(), "Finished");
+}
+
+TEST_F(FSMTestSuite, TestTableHotSwapConcurrent) {
+  auto v1 = StateMachine::TableType::Parse(kV1, StateMachine::Registry());
+  auto v3 = StateMachine::TableType::Parse(kV3, StateMachine::Registry());
+  Handle handle{v1};
+  std::atomic<bool> done{false};
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back([&] {
+      while (!done.load()) {
+        StateMachine machine{handle};
+        machine.Dispatch("go");
+        EXPECT_EQ(machine.CurrentStateName(), "Busy");
+        machine.Dispatch("stop");
+        EXPECT_NE(machine.CurrentStateName(), "Busy");
+      }
+    });
+  }
+
+  for (int i = 0; i < 1000; ++i)
+    handle.Publish(i % 2 ? *v1 : *v3, [](const std::string &name) -> std::string {
+      return name == "Done" ? "Finished" : name == "Finished" ? "Done" : name;
+    });
+  done = true;
+  for (auto &thread : threads)
+    thread.join();
+  EXPECT_EQ(handle.Reclaim(), 0u);
+}
+
+#pragma clang diagnostic pop
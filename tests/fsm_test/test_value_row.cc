@@ -0,0 +1,108 @@
+//
+// Created by fanghr on 2020/5/16.
+//
+
+#include "fsm_test.h"
+
+namespace {
+enum Opcode : unsigned char { kNop, kHello, kPing, kData, kAck, kReset, kBye = 0xf0 };
+
+class Protocol : public fsm::FSM<Protocol> {
+  friend class FSM;
+ public:
+  enum States { kIdle, kOpen, kBusy, kDone };
+
+  using Event = Opcode;
+
+  int bytes = 0;
+  int wildcard = 0;
+
+ private:
+  void Receive(const Event &) { ++bytes; }
+  void Fallback(const Event &) { ++wildcard; }
+  bool IsBusy(const Event &) const { return bytes >= 2; }
+
+  using TransitionTable = Table<
+  ValueRow<kIdle, Event, kHello, kOpen>,
+  ValueRow<kIdle, Event, kBye, kDone>,
+  ValueRow<kOpen, Event, kPing, kOpen>,
+  ValueRow<kOpen, Event, kData, kBusy, &Protocol::Receive, &Protocol::IsBusy>,
+  ValueRow<kOpen, Event, kData, kOpen, &Protocol::Receive>,
+  MemFnRow<kOpen, Event, kOpen, &Protocol::Fallback>, // any other opcode
+  ValueRow<kOpen, Event, kReset, kIdle>,              // shadowed by the row above
+  ValueRow<kOpen, Event, kBye, kDone>,
+  ValueRow<kBusy, Event, kAck, kOpen>,
+  ValueRow<kBusy, Event, kNop, kBusy>,
+  ValueRow<kBusy, Event, kPing, kBusy>,
+  ValueRow<kBusy, Event, kHello, kBusy>,
+  ValueRow<kBusy, Event, kBye, kDone>>;
+};
+
+class Counter : public fsm::FSM<Counter> {
+  friend class FSM;
+ public:
+  enum States { kStopped, kCounting };
+
+  using Event = int;
+
+  int total = 0;
+
+ private:
+  void Add(const Event &event) { total += event; }
+
+  using TransitionTable = Table<
+  ValueRow<kStopped, Event, 1, kCounting, &Counter::Add>,
+  ValueRow<kCounting, Event, 0, kStopped>,
+  ValueRow<kCounting, Event, 1, kCounting, &Counter::Add>,
+  ValueRow<kCounting, Event, 2, kCounting, &Counter::Add>,
+  ValueRow<kCounting, Event, 3, kCounting, &Counter::Add>,
+  ValueRow<kCounting, Event, 4, kCounting, &Counter::Add>,
+  ValueRow<kCounting, Event, 5, kCounting, &Counter::Add>>;
+};
+}
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "cert-err58-cpp"
+
+TEST_F(FSMTestSuite, TestValueRow) {
+  Protocol machine{};
+  EXPECT_EQ(machine(kPing), Protocol::kIdle);
+  EXPECT_EQ(machine(kHello), Protocol::kOpen);
+  EXPECT_EQ(machine(kPing), Protocol::kOpen);
+  EXPECT_EQ(machine(kData), Protocol::kOpen);
+  EXPECT_EQ(machine(kData), Protocol::kOpen);
+  EXPECT_EQ(machine.bytes, 2);
+  EXPECT_EQ(machine(kData), Protocol::kBusy);
+  EXPECT_EQ(machine.bytes, 3);
+  EXPECT_EQ(machine(kData), Protocol::kBusy); // no row
+  EXPECT_EQ(machine(kAck), Protocol::kOpen);
+  EXPECT_EQ(machine.wildcard, 0);
+  EXPECT_EQ(machine(kAck), Protocol::kOpen);
+  EXPECT_EQ(machine(kReset), Protocol::kOpen);
+  EXPECT_EQ(machine.wildcard, 2);
+  EXPECT_EQ(machine(kBye), Protocol::kOpen); // shadowed as well
+  EXPECT_EQ(machine.wildcard, 3);
+}
+
+TEST_F(FSMTestSuite, TestDenseValueRow) {
+  Counter machine{};
+  EXPECT_EQ(machine(1), Counter::kCounting);
+  EXPECT_EQ(machine(2), Counter::kCounting);
+  EXPECT_EQ(machine(3), Counter::kCounting);
+  EXPECT_EQ(machine(9), Counter::kCounting);
+  EXPECT_EQ(machine.total, 6);
+  EXPECT_EQ(machine(0), Counter::kStopped);
+  EXPECT_EQ(machine(5), Counter::kStopped);
+  EXPECT_EQ(machine.total, 6);
+}
+
+TEST_F(FSMTestSuite, TestValueRowPeek) {
+  Protocol machine{};
+  auto result = machine.PeekTransition(kBye);
+  EXPECT_TRUE(result.matched);
+  EXPECT_EQ(result.target, Protocol::kDone);
+  EXPECT_EQ(result.row, 1u);
+  EXPECT_FALSE(machine.PeekTransition(kData).matched);
+}
+
+#pragma clang diagnostic pop
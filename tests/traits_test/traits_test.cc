@@ -29,6 +29,29 @@ TEST_F(TraitsTestSuite, TestFilter) {
   ASSERT_TRUE((std::is_same<List<long, int>, Filter<std::is_integral, long, int>::Type>::value));
 }
 
+TEST_F(TraitsTestSuite, TestIndexOf) {
+  ASSERT_EQ((IndexOf<int, List<int>>::value), 0u);
+  ASSERT_EQ((IndexOf<int, List<int, char>>::value), 0u);
+  ASSERT_EQ((IndexOf<char, List<int, char>>::value), 1u);
+  ASSERT_EQ((IndexOf<long, List<int, char, long>>::value), 2u);
+}
+
+template<int v>
+using Int = IntegralConstant<int, v>;
+
+TEST_F(TraitsTestSuite, TestSortedUnique) {
+  ASSERT_TRUE((std::is_same<List<>, SortedUnique<>::Type>::value));
+  ASSERT_TRUE((std::is_same<List<Int<1>>, SortedUnique<Int<1>, Int<1>>::Type>::value));
+  ASSERT_TRUE((std::is_same<List<Int<-3>, Int<1>, Int<7>>,
+                            SortedUnique<Int<7>, Int<1>, Int<-3>, Int<7>>::Type>::value));
+}
+
+TEST_F(TraitsTestSuite, TestMakeIndexSequence) {
+  ASSERT_TRUE((std::is_same<IndexSequence<>, MakeIndexSequence<0>::Type>::value));
+  ASSERT_TRUE((std::is_same<IndexSequence<0>, MakeIndexSequence<1>::Type>::value));
+  ASSERT_TRUE((std::is_same<IndexSequence<0, 1, 2, 3, 4>, MakeIndexSequence<5>::Type>::value));
+}
+
 static void FooFunc() {}
 struct Foo {
   void operator()() {}
@@ -0,0 +1,357 @@
+// Copyright 2020 方泓睿
+//
+// 	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// 	documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+// fsmc: compiles a transition table description into a C++ header.
+//
+// The input is line based, `#` starts a comment:
+//
+//   machine <Name>                 # required, names the generated types
+//   namespace <ns>[::<ns>...]      # optional
+//   include <header>               # optional, repeatable, e.g. "events.h"
+//   states <state>...
+//   events <event type>...
+//   <start> <event> <target> [<action> | -] [<guard> | -]
+//
+// Actions and guards name member functions of the derived machine:
+// `void Action(const Event &)` and `bool Guard(const Event &) const`.
+//
+// The generated header defines `enum class <Name>State` and the class
+// template `<Name>Base<Derived, Policies...>`, which derives from
+// `fsm::FSM<Derived, <Name>State, Policies...>`. `Dispatch()` runs one
+// `switch` over the state per event type, so no row template is
+// instantiated: `TransitionTable` is empty. With `--table`, the rows are
+// declared as `TransitionTable` as well, so that `PeekTransition()`,
+// `fsm::Explorer` etc. work, at the compile-time cost of the row templates.
+// Statistics policies are rejected, since the `switch` doesn't call them.
+//
+// Usage: fsmc [--table] <input> -o <output>
+
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+struct Row {
+  std::string start, event, target, action, guard;
+  unsigned line;
+};
+
+struct Machine {
+  std::string name;
+  std::vector<std::string> namespaces;
+  std::vector<std::string> includes;
+  std::vector<std::string> states;
+  std::vector<std::string> events;
+  std::vector<Row> rows;
+};
+
+class Error : public std::runtime_error {
+ public:
+  Error(unsigned line, const std::string &what)
+      : std::runtime_error(line == 0 ? what : "line " + std::to_string(line) + ": " + what) {}
+};
+
+bool IsIdentifier(const std::string &name) {
+  if (name.empty() || std::isdigit(static_cast<unsigned char>(name[0])))
+    return false;
+  for (auto c : name) {
+    if (!std::isalnum(static_cast<unsigned char>(c)) && c != '_')
+      return false;
+  }
+  return true;
+}
+
+// `a::b::C`, optionally with a leading `::`
+bool IsQualifiedName(const std::string &name) {
+  std::string::size_type begin = name.compare(0, 2, "::") == 0 ? 2 : 0;
+  for (;;) {
+    auto end = name.find("::", begin);
+    if (!IsIdentifier(name.substr(begin, end == std::string::npos ? std::string::npos : end - begin)))
+      return false;
+    if (end == std::string::npos)
+      return true;
+    begin = end + 2;
+  }
+}
+
+std::vector<std::string> Split(const std::string &name, const std::string &separator) {
+  std::vector<std::string> parts;
+  std::string::size_type begin = 0;
+  for (;;) {
+    auto end = name.find(separator, begin);
+    parts.push_back(name.substr(begin, end == std::string::npos ? std::string::npos : end - begin));
+    if (end == std::string::npos)
+      return parts;
+    begin = end + separator.size();
+  }
+}
+
+Machine Parse(std::istream &input) {
+  Machine machine;
+  std::set<std::string> states, events;
+
+  std::string line;
+  for (unsigned line_no = 1; std::getline(input, line); ++line_no) {
+    auto comment = line.find('#');
+    if (comment != std::string::npos)
+      line.erase(comment);
+
+    std::istringstream words(line);
+    std::vector<std::string> tokens;
+    for (std::string token; words >> token;)
+      tokens.push_back(token);
+    if (tokens.empty())
+      continue;
+
+    if (tokens[0] == "machine" || tokens[0] == "namespace" || tokens[0] == "include") {
+      if (tokens.size() != 2)
+        throw Error(line_no, "expected '" + tokens[0] + " <name>'");
+      if (tokens[0] == "machine") {
+        if (!IsIdentifier(tokens[1]))
+          throw Error(line_no, "invalid machine name '" + tokens[1] + "'");
+        machine.name = tokens[1];
+      } else if (tokens[0] == "namespace") {
+        machine.namespaces = Split(tokens[1], "::");
+        for (auto &ns : machine.namespaces) {
+          if (!IsIdentifier(ns))
+            throw Error(line_no, "invalid namespace '" + tokens[1] + "'");
+        }
+      } else {
+        machine.includes.push_back(tokens[1]);
+      }
+      continue;
+    }
+
+    if (tokens[0] == "states" || tokens[0] == "events") {
+      auto is_state = tokens[0] == "states";
+      for (std::size_t i = 1; i < tokens.size(); ++i) {
+        if (is_state ? !IsIdentifier(tokens[i]) : !IsQualifiedName(tokens[i]))
+          throw Error(line_no, "invalid name '" + tokens[i] + "'");
+        if (!(is_state ? states : events).insert(tokens[i]).second)
+          throw Error(line_no, "duplicate name '" + tokens[i] + "'");
+        (is_state ? machine.states : machine.events).push_back(tokens[i]);
+      }
+      continue;
+    }
+
+    if (tokens.size() < 3 || tokens.size() > 5)
+      throw Error(line_no, "expected '<start> <event> <target> [<action>] [<guard>]'");
+    Row row{tokens[0], tokens[1], tokens[2], "", "", line_no};
+    for (auto state : {row.start, row.target}) {
+      if (states.count(state) == 0)
+        throw Error(line_no, "unknown state '" + state + "'");
+    }
+    if (events.count(row.event) == 0)
+      throw Error(line_no, "unknown event '" + row.event + "'");
+    if (tokens.size() > 3 && tokens[3] != "-")
+      row.action = tokens[3];
+    if (tokens.size() > 4 && tokens[4] != "-")
+      row.guard = tokens[4];
+    for (auto fn : {row.action, row.guard}) {
+      if (!fn.empty() && !IsIdentifier(fn))
+        throw Error(line_no, "invalid member function name '" + fn + "'");
+    }
+    machine.rows.push_back(row);
+  }
+
+  if (machine.name.empty())
+    throw Error(0, "missing 'machine <name>'");
+  if (machine.states.empty())
+    throw Error(0, "table declares no states");
+
+  // a row after an unguarded row with the same start and event never matches
+  std::map<std::pair<std::string, std::string>, unsigned> unguarded;
+  for (auto &row : machine.rows) {
+    auto key = std::make_pair(row.start, row.event);
+    auto it = unguarded.find(key);
+    if (it != unguarded.end())
+      throw Error(row.line, "unreachable row, shadowed by the unguarded row on line " + std::to_string(it->second));
+    if (row.guard.empty())
+      unguarded.emplace(key, row.line);
+  }
+  return machine;
+}
+
+std::string ActionType(const std::string &event) { return "void (*)(Derived &, const " + event + " &)"; }
+
+std::string GuardType(const std::string &event) { return "bool (*)(const Derived &, const " + event + " &)"; }
+
+void Generate(const Machine &machine, const std::string &source, bool table, std::ostream &out) {
+  auto state_type = machine.name + "State";
+  auto base = machine.name + "Base";
+  std::string guard = "FSMC_";
+  for (auto &ns : machine.namespaces)
+    guard += ns + "_";
+  guard += machine.name + "_H_";
+  for (auto &c : guard)
+    c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+
+  out << "// Generated by fsmc from " << source << ". Do not edit.\n\n"
+      << "#ifndef " << guard << "\n#define " << guard << "\n\n"
+      << "#include <fsm/fsm.h>\n";
+  for (auto &include : machine.includes)
+    out << "#include " << include << "\n";
+  out << "\n";
+  for (auto &ns : machine.namespaces)
+    out << "namespace " << ns << " {\n";
+
+  out << "enum class " << state_type << " {";
+  for (std::size_t i = 0; i < machine.states.size(); ++i)
+    out << (i == 0 ? " " : ", ") << machine.states[i];
+  out << " };\n\n";
+
+  out << "template<class Derived, class... Policies>\n"
+      << "class " << base << " : public fsm::FSM<Derived, " << state_type << ", Policies...> {\n"
+      << "  using Base = fsm::FSM<Derived, " << state_type << ", Policies...>;\n\n"
+      << "  static_assert(fsm::detail::IsSame<typename Base::StatisticsType, fsm::detail::NoStatistics>::value,\n"
+      << "                \"the dispatch generated by fsmc doesn't call statistics hooks\");\n\n"
+      << " public:\n"
+      << "  using States = " << state_type << ";\n"
+      << "  using typename Base::StateType;\n"
+      << "  using typename Base::DispatchResultType;\n\n"
+      << "  explicit " << base << "(StateType init_state = States::" << machine.states[0] << ") : Base(init_state) {}\n\n"
+      << "  using Base::Dispatch;\n"
+      << "  using Base::operator();\n";
+
+  // rows grouped by event, then by start state, keeping table order
+  std::map<std::string, std::map<std::string, std::vector<const Row *>>> by_event;
+  for (auto &row : machine.rows)
+    by_event[row.event][row.start].push_back(&row);
+
+  for (auto &event : machine.events) {
+    if (by_event.count(event) == 0)
+      continue;
+    out << "\n  DispatchResultType Dispatch(const " << event << " &event) {\n"
+        << "    return Base::template DispatchWith<Switch>(event);\n"
+        << "  }\n\n"
+        << "  DispatchResultType operator()(const " << event << " &event) { return Dispatch(event); }\n";
+  }
+
+  if (table) {
+    out << "\n private:\n";
+    for (std::size_t i = 0; i < machine.rows.size(); ++i) {
+      auto &row = machine.rows[i];
+      if (!row.action.empty())
+        out << "  static void Action" << i << "(Derived &self, const " << row.event << " &event) { self."
+            << row.action << "(event); }\n";
+      if (!row.guard.empty())
+        out << "  static bool Guard" << i << "(const Derived &self, const " << row.event << " &event) { return self."
+            << row.guard << "(event); }\n";
+    }
+  }
+
+  out << "\n public:\n  using TransitionTable = typename Base::template Table<";
+  for (std::size_t i = 0; table && i < machine.rows.size(); ++i) {
+    auto &row = machine.rows[i];
+    out << (i == 0 ? "\n" : ",\n")
+        << "      typename Base::template BasicRow<States::" << row.start << ", " << row.event << ", States::"
+        << row.target;
+    if (!row.action.empty() || !row.guard.empty()) {
+      if (row.action.empty())
+        out << ", fsm::detail::NullPointerType, nullptr";
+      else
+        out << ", " << ActionType(row.event) << ", &" << base << "::Action" << i;
+      if (!row.guard.empty())
+        out << ", " << GuardType(row.event) << ", &" << base << "::Guard" << i;
+    }
+    out << ">";
+  }
+  out << ">;\n\n private:\n";
+
+  out << "  struct Switch {\n";
+  for (auto &event : machine.events) {
+    auto it = by_event.find(event);
+    if (it == by_event.end())
+      continue;
+    out << "    static StateType Execute(Derived &self, const " << event << " &event, StateType state) {\n"
+        << "      switch (state) {\n";
+    for (auto &state : machine.states) {
+      auto start = it->second.find(state);
+      if (start == it->second.end())
+        continue;
+      out << "        case States::" << state << ":\n";
+      bool unguarded = false;
+      for (auto row : start->second) {
+        auto indent = row->guard.empty() ? "          " : "            ";
+        if (!row->guard.empty())
+          out << "          if (self." << row->guard << "(event)) {\n";
+        if (!row->action.empty())
+          out << indent << "self." << row->action << "(event);\n";
+        out << indent << "return States::" << row->target << ";\n";
+        if (!row->guard.empty())
+          out << "          }\n";
+        unguarded = row->guard.empty();
+      }
+      if (!unguarded)
+        out << "          break;\n";
+    }
+    out << "        default:\n"
+        << "          break;\n"
+        << "      }\n"
+        << "      return self.NoTransition(event);\n"
+        << "    }\n";
+  }
+  out << "  };\n"
+      << "};\n";
+
+  for (auto it = machine.namespaces.rbegin(); it != machine.namespaces.rend(); ++it)
+    out << "} // namespace " << *it << "\n";
+  out << "\n#endif //" << guard << "\n";
+}
+}
+
+int main(int argc, char *argv[]) {
+  std::string input_path, output_path;
+  bool table = false, usage_error = false;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--table")
+      table = true;
+    else if (arg == "-o" && i + 1 < argc)
+      output_path = argv[++i];
+    else if (input_path.empty())
+      input_path = arg;
+    else
+      usage_error = true;
+  }
+  if (usage_error || input_path.empty() || output_path.empty()) {
+    std::cerr << "usage: fsmc [--table] <input> -o <output>\n";
+    return 2;
+  }
+
+  std::ifstream input(input_path);
+  if (!input) {
+    std::cerr << input_path << ": cannot open\n";
+    return 1;
+  }
+
+  std::ostringstream header;
+  try {
+    Generate(Parse(input), input_path, table, header);
+  } catch (const Error &e) {
+    std::cerr << input_path << ": error: " << e.what() << "\n";
+    return 1;
+  }
+
+  std::ofstream output(output_path);
+  if (!(output << header.str())) {
+    std::cerr << output_path << ": cannot write\n";
+    return 1;
+  }
+  return 0;
+}